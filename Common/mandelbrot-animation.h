@@ -0,0 +1,180 @@
+//
+//  mandelbrot-animation.h
+//
+//
+//  Zoom animations rendered by the dynamic hybrid program when
+//  MANDELBROT_ANIMATION names a keyframe file.
+//
+//  Each line of the file is a keyframe, "frame zoom re im", with the
+//  frames in increasing order; lines starting with # are comments:
+//
+//      # frame   zoom     re                    im
+//      0         1        -0.5                  0
+//      299       1e9      -0.743643887037158    0.131825904205311
+//
+//  The frames between two keyframes zoom at a constant rate, and the
+//  center moves so that the point of the next keyframe slides to the
+//  middle of the image as it is approached. The animation has as many
+//  frames as the number of the last keyframe plus one.
+//
+//  The frames are written to stdout one after the other, in order, as
+//  soon as each one is complete, so an encoder can read them from a pipe:
+//
+//      MANDELBROT_ANIMATION=zoom.txt mpirun ... | ffmpeg -i - zoom.mp4
+//
+//  MANDELBROT_VIDEO selects the stream: ppm (default), a PPM image per
+//  frame, or y4m, a YUV4MPEG2 stream in 4:4:4 at MANDELBROT_FPS frames
+//  per second (25 by default). In raw mode every frame is a raw file.
+//
+
+#ifndef MANDELBROT_ANIMATION_H
+#define MANDELBROT_ANIMATION_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mandelbrot-kernel.h"
+#include "mandelbrot-output.h"
+
+// Largest number of keyframes of an animation
+#define ANIMATION_KEYFRAMES 1024
+
+// Zoom and center of the view at a frame of the animation
+struct keyframe
+{
+    int frame;
+    double zoom, re, im;
+};
+
+// Keyframes read by animationInit
+static struct keyframe animationKeys[ANIMATION_KEYFRAMES];
+static int animationKeyCount = 0;
+
+// Frames of the animation, 0 when a single image is rendered
+static int animationFrames = 0;
+
+// Whether the frames are written as a YUV4MPEG2 stream instead of PPM images, and its frame rate
+static int animationY4m = 0;
+static int animationFps = 25;
+
+// Reads the keyframe file named by MANDELBROT_ANIMATION, if it is set
+// Returns 0, or -1 if the file cannot be read or its keyframes are not in order
+static int animationInit(void)
+{
+    const char *path = getenv("MANDELBROT_ANIMATION");
+    const char *video = getenv("MANDELBROT_VIDEO");
+    const char *fps = getenv("MANDELBROT_FPS");
+    char line[512];
+    FILE *file;
+
+    if (path == NULL)
+        return 0;
+
+    animationY4m = (video != NULL && strcmp(video, "y4m") == 0);
+    animationFps = (fps != NULL && atoi(fps) > 0) ? atoi(fps) : 25;
+
+    if ((file = fopen(path, "r")) == NULL)
+        return -1;
+
+    while (fgets(line, sizeof(line), file) != NULL && animationKeyCount < ANIMATION_KEYFRAMES)
+    {
+        struct keyframe *key = &animationKeys[animationKeyCount];
+
+        if (line[0] == '#' || sscanf(line, "%d %lf %lf %lf", &key->frame, &key->zoom, &key->re, &key->im) != 4)
+            continue;
+
+        if (key->zoom <= 0 || (animationKeyCount > 0 && key->frame <= animationKeys[animationKeyCount - 1].frame))
+        {
+            fclose(file);
+            return -1;
+        }
+
+        animationKeyCount++;
+    }
+
+    fclose(file);
+
+    if (animationKeyCount == 0)
+        return -1;
+
+    animationFrames = animationKeys[animationKeyCount - 1].frame + 1;
+
+    return 0;
+}
+
+// Sets the zoom and center of view to those of frame, interpolated between its keyframes
+static void animationView(int frame, struct view *view)
+{
+    const struct keyframe *a = &animationKeys[0], *b;
+    int k;
+
+    for (k = 1; k < animationKeyCount && animationKeys[k].frame <= frame; k++)
+        a = &animationKeys[k];
+
+    if (k == animationKeyCount || frame <= a->frame)
+    {
+        view->zoom = a->zoom;
+        view->moveX = a->re;
+        view->moveY = a->im;
+        return;
+    }
+
+    b = &animationKeys[k];
+
+    double t = (double)(frame - a->frame) / (b->frame - a->frame);
+
+    // the zoom grows exponentially between the keyframes
+    view->zoom = a->zoom * pow(b->zoom / a->zoom, t);
+
+    // the center covers the distance in proportion to how much the width of the view shrank,
+    // which keeps the point of b still on the screen while zooming into it
+    double u = (a->zoom == b->zoom) ? t : (1 / a->zoom - 1 / view->zoom) / (1 / a->zoom - 1 / b->zoom);
+
+    view->moveX = a->re + u * (b->re - a->re);
+    view->moveY = a->im + u * (b->im - a->im);
+}
+
+// Writes the header of the YUV4MPEG2 stream, before the first frame
+static void animationStart(int w, int h)
+{
+    char header[128];
+
+    if (!animationY4m)
+        return;
+
+    snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", w, h, animationFps);
+    outputFrame(header, NULL, 0);
+}
+
+// Writes a frame: its header (the PPM or raw header of an image) followed by size bytes of pixels,
+// or, in a YUV4MPEG2 stream, the w x h R, G, B pixels converted to the Y, U and V planes
+static void animationWrite(const char *header, const unsigned char *pixels, size_t size, int w, int h)
+{
+    static unsigned char *planes = NULL;
+    size_t count = (size_t)w * h, p;
+
+    if (!animationY4m)
+    {
+        outputFrame(header, pixels, size);
+        return;
+    }
+
+    if (planes == NULL)
+        planes = malloc(3 * count);
+
+    // BT.601 studio range, as the encoders expect from a YUV4MPEG2 stream
+    for (p = 0; p < count; p++)
+    {
+        int r = pixels[3 * p], g = pixels[3 * p + 1], b = pixels[3 * p + 2];
+
+        planes[p] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        planes[count + p] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+        planes[2 * count + p] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+
+    outputFrame("FRAME\n", planes, 3 * count);
+}
+
+#endif
@@ -0,0 +1,305 @@
+//
+//  mandelbrot-antialias.h
+//
+//
+//  Edge-adaptive anti-aliasing, enabled by MANDELBROT_AA, the budget of
+//  samples per pixel.
+//
+//  The image is calculated with one sample per pixel as usual. Then each
+//  pixel is compared with its eight neighbours, and only the pixels whose
+//  color differs from one of them by more than MANDELBROT_AA_THRESHOLD in
+//  a channel, along the boundary of the set and the filaments, take more
+//  samples:
+//
+//  - first AA_FIRST jittered sub-samples inside the pixel
+//  - then the rest of the budget, if any of those has a different color
+//    than the pixel
+//
+//  The pixel takes the average color of all its samples. The sub-samples
+//  follow the R2 low-discrepancy sequence, shifted by a hash of the pixel
+//  coordinates, so the image does not depend on how it was divided into
+//  rows, tiles or processes.
+//
+//  The rectangle being smoothed is compared with the pixels around it,
+//  which are iterated again when they belong to the image. Sub-samples
+//  are iterated in double precision, with the kernel selected by
+//  escapeInit; raw output and the perturbation engine are left as they
+//  are.
+//
+
+#ifndef MANDELBROT_ANTIALIAS_H
+#define MANDELBROT_ANTIALIAS_H
+
+#include <omp.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mandelbrot-kernel.h"
+
+// Sub-samples taken first in an edge pixel, before deciding whether to spend the rest of the budget
+#define AA_FIRST 4
+
+// Sub-samples iterated at once by the kernel
+#define AA_BATCH 1024
+
+// Default color difference, in any channel, between neighbours that makes a pixel an edge pixel
+#define AA_THRESHOLD 24
+
+// Edge pixels and sub-samples iterated, added up by antialiasRect
+static long long antialiasPixels = 0, antialiasSamples = 0;
+
+// Samples per pixel allowed by MANDELBROT_AA, 1 (no anti-aliasing) when it is not set
+static int antialiasBudget(void)
+{
+    const char *budget = getenv("MANDELBROT_AA");
+
+    return (budget != NULL && atoi(budget) > 1) ? atoi(budget) : 1;
+}
+
+// Whether MANDELBROT_AA asks for more than one sample per pixel
+static int antialiasSelected(void)
+{
+    return antialiasBudget() > 1;
+}
+
+// Color difference that makes a pixel an edge pixel, MANDELBROT_AA_THRESHOLD
+static int antialiasThreshold(void)
+{
+    const char *threshold = getenv("MANDELBROT_AA_THRESHOLD");
+
+    return (threshold != NULL) ? atoi(threshold) : AA_THRESHOLD;
+}
+
+// Color of a sample that escaped after i iterations, as the programs color their pixels
+static inline void antialiasColor(int i, double norm, int maxIterations, unsigned char *rgb)
+{
+    int brightness = (i == maxIterations) ? 0 : escapeBrightness(i, norm, maxIterations);
+
+    rgb[0] = brightness;
+    rgb[1] = brightness;
+    rgb[2] = (i == maxIterations) ? 0 : 255;
+}
+
+// Offset, from -0.5 to 0.5, of sub-sample k of pixel (x, y) along one axis: the R2 sequence shifted per pixel
+static inline double antialiasJitter(int x, int y, int k, int axis)
+{
+    unsigned int hash = (unsigned int)x * 0x9E3779B1u ^ (unsigned int)y * 0x85EBCA77u ^ (unsigned int)axis * 0xC2B2AE3Du;
+    double step = axis ? 0.5698402909980532 : 0.7548776662466927;
+    double u;
+
+    hash ^= hash >> 15;
+    hash *= 0x2C1B3C6Du;
+    hash ^= hash >> 12;
+
+    u = (hash >> 8) / 16777216.0 + k * step;
+
+    return u - (int)u - 0.5;
+}
+
+// Sub-samples of the edge pixels of a row, queued until AA_BATCH of them are iterated at once
+struct antialiasBatch
+{
+    struct escapeWork work;
+    int n, maxIterations;
+    long long samples;
+
+    // edge pixel of each queued sample
+    int *owner;
+
+    // sum of the colors of the samples of each edge pixel, its center color, and whether a sample differed from it
+    int *sums;
+    unsigned char *centers, *differs;
+};
+
+// Iterates the queued samples and adds their colors to the sums of their edge pixels,
+// flagging the pixels with a sample whose color is not the color of their center
+static void antialiasFlush(struct antialiasBatch *batch)
+{
+    int k;
+
+    if (batch->n == 0)
+        return;
+
+    escapePoints(&batch->work, batch->n, batch->maxIterations);
+
+    for (k = 0; k < batch->n; k++)
+    {
+        unsigned char rgb[3];
+        int p = batch->owner[k];
+
+        antialiasColor(batch->work.iterations[k], batch->work.norms[k], batch->maxIterations, rgb);
+
+        batch->sums[3 * p] += rgb[0];
+        batch->sums[3 * p + 1] += rgb[1];
+        batch->sums[3 * p + 2] += rgb[2];
+
+        if (memcmp(rgb, batch->centers + 3 * p, 3) != 0)
+            batch->differs[p] = 1;
+    }
+
+    batch->samples += batch->n;
+    batch->n = 0;
+}
+
+// Queues sub-sample k of edge pixel p, at (x, y) of the image
+static void antialiasQueue(struct antialiasBatch *batch, const struct view *view, int p, int x, int y, int k)
+{
+    double dx = pixelRe(view, 1) - pixelRe(view, 0), dy = pixelIm(view, 1) - pixelIm(view, 0);
+
+    if (batch->n == AA_BATCH)
+        antialiasFlush(batch);
+
+    batch->owner[batch->n] = p;
+    batch->work.cr[batch->n] = pixelRe(view, x) + antialiasJitter(x, y, k, 0) * dx;
+    batch->work.ci[batch->n++] = pixelIm(view, y) + antialiasJitter(x, y, k, 1) * dy;
+}
+
+// Colors the pixels of the grid around the rectangle that belong to the image: top and bottom rows, left and right columns
+static void antialiasBorder(const struct view *view, int x0, int y0, int gw, int gh, int maxIterations, unsigned char *grid, struct escapeWork *work, int *cells)
+{
+    int k, n = 0, border = 2 * gw + 2 * (gh - 2);
+
+    for (k = 0; k < border; k++)
+    {
+        int gx = (k < 2 * gw) ? k % gw : ((k - 2 * gw) % 2) * (gw - 1);
+        int gy = (k < 2 * gw) ? (k / gw) * (gh - 1) : (k - 2 * gw) / 2 + 1;
+        int x = x0 - 1 + gx, y = y0 - 1 + gy;
+
+        if (x >= 0 && x < view->w && y >= 0 && y < view->h)
+        {
+            cells[n] = gy * gw + gx;
+            work->cr[n] = pixelRe(view, x);
+            work->ci[n++] = pixelIm(view, y);
+        }
+
+        if (n == AA_BATCH || (k == border - 1 && n > 0))
+        {
+            int c;
+
+            escapePoints(work, n, maxIterations);
+
+            for (c = 0; c < n; c++)
+                antialiasColor(work->iterations[c], work->norms[c], maxIterations, grid + (size_t)cells[c] * 3);
+
+            n = 0;
+        }
+    }
+}
+
+// Smooths the edges of the tw x th rectangle at (x0, y0) of the image, already colored with one sample per pixel
+// in pixels (R, G, B bytes, rows stride pixels apart). Opens its own parallel region; called from inside one,
+// the rectangle is smoothed by the calling thread only
+static void antialiasRect(const struct view *view, int x0, int y0, int tw, int th, int maxIterations, unsigned char *pixels, int stride)
+{
+    int budget = antialiasBudget(), threshold = antialiasThreshold();
+    int first = (budget - 1 < AA_FIRST) ? budget - 1 : AA_FIRST;
+    int gw = tw + 2, gh = th + 2;
+    long long edges = 0, samples = 0;
+    unsigned char *grid;
+    int y;
+
+    if (tw <= 0 || th <= 0)
+        return;
+
+    // colors of the rectangle as calculated and of the pixels around it: the grid starts at (x0 - 1, y0 - 1)
+    grid = malloc((size_t)gw * gh * 3);
+
+    for (y = 0; y < th; y++)
+        memcpy(grid + ((size_t)(y + 1) * gw + 1) * 3, pixels + (size_t)y * stride * 3, (size_t)tw * 3);
+
+    #pragma omp parallel private(y) reduction(+:edges, samples) if (!omp_in_parallel())
+    {
+        struct antialiasBatch batch = {.n = 0, .maxIterations = maxIterations, .samples = 0};
+        int *edge = malloc(sizeof(int) * tw);
+
+        escapeWorkInit(&batch.work, AA_BATCH);
+        batch.owner = malloc(sizeof(int) * AA_BATCH);
+        batch.sums = malloc(sizeof(int) * 3 * tw);
+        batch.centers = malloc(3 * tw);
+        batch.differs = malloc(tw);
+
+        #pragma omp single
+        antialiasBorder(view, x0, y0, gw, gh, maxIterations, grid, &batch.work, batch.owner);
+
+        #pragma omp for schedule(dynamic)
+        for (y = 0; y < th; y++)
+        {
+            unsigned char *out = pixels + (size_t)y * stride * 3;
+            int count = 0, x, k, e;
+
+            // an edge pixel differs from one of its neighbours in the image by more than the threshold
+            for (x = 0; x < tw; x++)
+            {
+                const unsigned char *c = grid + ((size_t)(y + 1) * gw + x + 1) * 3;
+                int isEdge = 0, ox, oy;
+
+                for (oy = -1; oy <= 1 && !isEdge; oy++)
+                {
+                    for (ox = -1; ox <= 1 && !isEdge; ox++)
+                    {
+                        const unsigned char *o = c + ((ptrdiff_t)oy * gw + ox) * 3;
+
+                        if (x0 + x + ox < 0 || x0 + x + ox >= view->w || y0 + y + oy < 0 || y0 + y + oy >= view->h)
+                            continue;
+
+                        isEdge = abs(o[0] - c[0]) > threshold || abs(o[1] - c[1]) > threshold || abs(o[2] - c[2]) > threshold;
+                    }
+                }
+
+                if (isEdge)
+                {
+                    edge[count] = x;
+                    memcpy(batch.centers + 3 * count, c, 3);
+
+                    for (k = 0; k < 3; k++)
+                        batch.sums[3 * count + k] = c[k];
+
+                    batch.differs[count++] = 0;
+                }
+            }
+
+            // first sub-samples of every edge pixel, then the rest of the budget where they disagreed with the pixel
+            for (e = 0; e < count; e++)
+                for (k = 1; k <= first; k++)
+                    antialiasQueue(&batch, view, e, x0 + edge[e], y0 + y, k);
+
+            antialiasFlush(&batch);
+
+            for (e = 0; e < count; e++)
+                for (k = first + 1; k < budget && batch.differs[e]; k++)
+                    antialiasQueue(&batch, view, e, x0 + edge[e], y0 + y, k);
+
+            antialiasFlush(&batch);
+
+            // each edge pixel takes the average of its samples
+            for (e = 0; e < count; e++)
+            {
+                int taken = batch.differs[e] ? budget : first + 1;
+
+                for (k = 0; k < 3; k++)
+                    out[edge[e] * 3 + k] = (batch.sums[3 * e + k] + taken / 2) / taken;
+            }
+
+            edges += count;
+        }
+
+        samples += batch.samples;
+
+        escapeWorkFree(&batch.work);
+        free(batch.owner);
+        free(batch.sums);
+        free(batch.centers);
+        free(batch.differs);
+        free(edge);
+    }
+
+    free(grid);
+
+    #pragma omp atomic
+    antialiasPixels += edges;
+
+    #pragma omp atomic
+    antialiasSamples += samples;
+}
+
+#endif
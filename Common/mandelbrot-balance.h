@@ -0,0 +1,142 @@
+//
+//  mandelbrot-balance.h
+//
+//
+//  Cost model used by the static hybrid program to cut the image into
+//  bands of equal work instead of equal rows.
+//
+//  Before the image is calculated, a preview of at most BALANCE_PREVIEW x
+//  BALANCE_PREVIEW points, one in the middle of each cell of a grid over
+//  the image, is iterated with at most BALANCE_ITERATIONS iterations:
+//
+//  - a point that escaped, or whose orbit was found to be periodic, costs
+//    the iterations it took, as it will in the image
+//  - a point still pending at the cap is counted as maxIterations
+//  - a point painted by the interior pre-check only costs the work every
+//    pixel takes besides iterating, BALANCE_PIXEL_COST iterations
+//
+//  Each row of the preview stands for the stripe of image rows around it.
+//  The bands end where the cumulative cost of the rows reaches an equal
+//  share of the total, so the rows crossing the main cardioid end up in
+//  narrow bands and the empty rows at the top and bottom in wide ones.
+//
+//  MANDELBROT_BALANCE=rows restores bands with the same number of rows.
+//
+
+#ifndef MANDELBROT_BALANCE_H
+#define MANDELBROT_BALANCE_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mandelbrot-kernel.h"
+
+// Points per row and per column of the preview, at most
+#define BALANCE_PREVIEW 256
+
+// Iteration cap of the preview
+#define BALANCE_ITERATIONS 256
+
+// Iterations worth of work spent on every pixel besides iterating it (coordinates, color, copies)
+#define BALANCE_PIXEL_COST 4
+
+// Whether the bands are cut from the cost model, MANDELBROT_BALANCE is not rows
+static int balanceSelected(void)
+{
+    const char *balance = getenv("MANDELBROT_BALANCE");
+
+    return balance == NULL || strcmp(balance, "rows") != 0;
+}
+
+// Rows of the preview of an image h rows high
+static int balancePreviewRows(int h)
+{
+    return (h < BALANCE_PREVIEW) ? h : BALANCE_PREVIEW;
+}
+
+// First image row of the stripe of preview row k, out of rows
+static int balanceStripe(int k, int rows, int h)
+{
+    return (int)((long long)k * h / rows);
+}
+
+// Estimates the cost of the stripes of the preview rows part, part + parts, part + 2 * parts... into cost,
+// in iterations; the other entries of cost are left as they are
+static void balancePreview(const struct view *view, int maxIterations, int part, int parts, double *cost)
+{
+    int rows = balancePreviewRows(view->h);
+    int columns = (view->w < BALANCE_PREVIEW) ? view->w : BALANCE_PREVIEW;
+    int cap = (maxIterations < BALANCE_ITERATIONS) ? maxIterations : BALANCE_ITERATIONS;
+    int k;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (k = part; k < rows; k += parts)
+    {
+        // the preview row lies in the middle of its stripe
+        int first = balanceStripe(k, rows, view->h), last = balanceStripe(k + 1, rows, view->h);
+        double pi = pixelIm(view, (first + last) / 2);
+        struct escapeStats stats = {0, 0, 0, 0};
+        double sum = 0;
+        int j;
+
+        for (j = 0; j < columns; j++)
+        {
+            double pr = pixelRe(view, (int)((2LL * j + 1) * view->w / (2 * columns)));
+            long long slots = stats.slots, cycles = stats.cycles;
+            double norm;
+
+            sum += BALANCE_PIXEL_COST;
+
+            if (escapeCheckInterior && escapeInterior(pr, pi))
+                continue;
+
+            // a pixel still pending at the cap may run all the way to maxIterations
+            if (escapePoint(pr, pi, cap, &norm, &stats) >= cap && stats.cycles == cycles)
+                sum += maxIterations;
+            else
+                sum += stats.slots - slots;
+        }
+
+        // every point stands for the pixels of its cell
+        cost[k] = sum * view->w / columns * (last - first);
+    }
+}
+
+// Cuts the h rows of the image into bands of equal cost, from the cost of the rows preview stripes:
+// band b takes rows first[b]..first[b + 1]-1 and, if bandCost is not NULL, its cost goes to bandCost[b]
+static void balanceBands(const double *cost, int rows, int h, int bands, int *first, double *bandCost)
+{
+    double total = 0, sum = 0;
+    int k, y, b = 0;
+
+    for (k = 0; k < rows; k++)
+        total += cost[k];
+
+    first[0] = 0;
+
+    if (bandCost != NULL)
+        memset(bandCost, 0, sizeof(double) * bands);
+
+    // the rows of a stripe share its cost; a band ends after the row that reaches its share of the total
+    for (k = 0; k < rows; k++)
+    {
+        int stripeFirst = balanceStripe(k, rows, h), stripeLast = balanceStripe(k + 1, rows, h);
+        double rowCost = cost[k] / (stripeLast - stripeFirst);
+
+        for (y = stripeFirst; y < stripeLast; y++)
+        {
+            sum += rowCost;
+
+            if (bandCost != NULL)
+                bandCost[b] += rowCost;
+
+            while (b < bands - 1 && sum >= total * (b + 1) / bands)
+                first[++b] = y + 1;
+        }
+    }
+
+    while (b < bands)
+        first[++b] = h;
+}
+
+#endif
@@ -0,0 +1,29 @@
+//
+//  mandelbrot-color.h
+//
+//
+//  Smooth coloring shared by the programs and the recolor tool.
+//
+//  A pixel outside the set is colored from the iteration in which it
+//  escaped and its final |z|^2, which the kernels keep for every pixel and
+//  the raw output stores. The brightness grows with the fractional
+//  escape count, so neighbouring pixels with the same iteration still get
+//  different shades.
+//
+//  It depends on nothing else, so the recolor tool can include it without
+//  the kernels.
+//
+
+#ifndef MANDELBROT_COLOR_H
+#define MANDELBROT_COLOR_H
+
+#include <math.h>
+
+// Smooth coloring brightness of a pixel that escaped after i iterations
+static inline int escapeBrightness(int i, double norm, int maxIterations)
+{
+    double z = sqrt(norm);
+    return 256 * log2(1.75 + i - log2(log2(z))) / log2((double)maxIterations);
+}
+
+#endif
@@ -0,0 +1,157 @@
+//
+//  mandelbrot-expmap.h
+//
+//
+//  Exponential map of a zoom animation, rendered by the OMP program when
+//  MANDELBROT_ANIMATION names a keyframe file.
+//
+//  Zooming into a point, every frame recalculates most of the previous
+//  one at a smaller scale. Instead, the point c = center + r e^(i theta)
+//  is sampled once on a log-polar strip:
+//
+//  - column k: theta = 2 pi k / columns - pi
+//  - row j:    r = radius e^(-2 pi j / columns)
+//
+//  The samples of a row are as far apart along the circle as the rows are
+//  along the radius, and both shrink with r, so the strip keeps the same
+//  detail at every scale. There are enough columns for a sample to be no
+//  wider than a pixel at the corners of any frame, and enough rows to go
+//  from the corners of the widest frame to half a pixel of the deepest.
+//
+//  Each frame is then resampled from the strip: the angle and logarithm
+//  of the radius of every pixel are computed once, and a frame at zoom z
+//  only shifts the radius by log z. Colors are interpolated between the
+//  four nearest samples; raw frames take the nearest sample.
+//
+//  The strip is calculated in double precision, with the escape kernel
+//  selected by escapeInit, and zooms straight into the center of the last
+//  keyframe; the zoom of each frame follows the keyframes.
+//
+
+#ifndef MANDELBROT_EXPMAP_H
+#define MANDELBROT_EXPMAP_H
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mandelbrot-kernel.h"
+
+// Columns (angles) and rows (radii) of the strip
+static int expmapColumns = 0, expmapRows = 0;
+
+// Radius of the first row and center of the zoom
+static double expmapRadius = 0, expmapCenterRe = 0, expmapCenterIm = 0;
+
+// Column, as a fraction, and logarithm of the radius at zoom 1 of every pixel of a frame
+static double *expmapAngle = NULL, *expmapLogRadius = NULL;
+
+// Sets up the strip covering the frames of a w x h view from zoom zoomMin to zoomMax, centered on (re, im)
+static void expmapInit(int w, int h, double zoomMin, double zoomMax, double re, double im)
+{
+    // the distance between two pixels of a frame at zoom 1, the smaller of both axes
+    double spacing = fmin(3.0 / w, 2.0 / h);
+    double steps;
+    int x, y;
+
+    expmapCenterRe = re;
+    expmapCenterIm = im;
+
+    // a column is at most one pixel wide at the corners of every frame, rounded up to a whole number of vectors
+    expmapColumns = ((int)ceil(2 * M_PI * hypot(1.5, 1) / spacing) + 7) / 8 * 8;
+
+    // from the corners of the widest frame to half a pixel of the deepest one
+    expmapRadius = hypot(1.5, 1) / zoomMin;
+    steps = log(expmapRadius / (0.5 * spacing / zoomMax)) * expmapColumns / (2 * M_PI);
+    expmapRows = (int)ceil(steps) + 2;
+
+    expmapAngle = malloc(sizeof(double) * w * h);
+    expmapLogRadius = malloc(sizeof(double) * w * h);
+
+    // the pixels of a frame keep their angle at every zoom, only their radius shrinks
+    for (y = 0; y < h; y++)
+    {
+        for (x = 0; x < w; x++)
+        {
+            double dx = 1.5 * (x - w / 2) / (0.5 * w), dy = (y - h / 2) / (0.5 * h);
+
+            expmapAngle[y * w + x] = (atan2(dy, dx) + M_PI) * expmapColumns / (2 * M_PI);
+            expmapLogRadius[y * w + x] = log(hypot(dx, dy));
+        }
+    }
+}
+
+// Deallocates the tables of the frame pixels
+static void expmapFree(void)
+{
+    free(expmapAngle);
+    free(expmapLogRadius);
+}
+
+// Iterates the expmapColumns samples of row j of the strip, the results are left in work
+static void expmapRow(int j, int maxIterations, struct escapeWork *work)
+{
+    double r = expmapRadius * exp(-2 * M_PI * j / expmapColumns);
+    int k;
+
+    for (k = 0; k < expmapColumns; k++)
+    {
+        double theta = 2 * M_PI * k / expmapColumns - M_PI;
+
+        work->cr[k] = expmapCenterRe + r * cos(theta);
+        work->ci[k] = expmapCenterIm + r * sin(theta);
+    }
+
+    escapePoints(work, expmapColumns, maxIterations);
+}
+
+// Resamples the w x h frame at zoom from the strip into frame, pixels of pixelSize bytes:
+// R, G, B bytes interpolated between the four nearest samples, or the nearest raw record
+static void expmapFrame(const unsigned char *strip, size_t pixelSize, int raw, int w, int h, double zoom, unsigned char *frame)
+{
+    // row of the strip of a pixel at zoom 1 with log radius 0
+    double shift = (log(expmapRadius) + log(zoom)) * expmapColumns / (2 * M_PI);
+    double scale = expmapColumns / (2 * M_PI);
+    int p;
+
+    #pragma omp parallel for schedule(static)
+    for (p = 0; p < w * h; p++)
+    {
+        double u = expmapAngle[p], v = shift - expmapLogRadius[p] * scale;
+        unsigned char *out = frame + p * pixelSize;
+
+        // the center of the frame and pixels closer to it than the last row take the last row
+        if (!(v < expmapRows - 1))
+            v = expmapRows - 1;
+
+        if (v < 0)
+            v = 0;
+
+        if (raw)
+        {
+            int k = (int)lround(u) % expmapColumns, j = (int)lround(v);
+
+            memcpy(out, strip + ((size_t)j * expmapColumns + k) * pixelSize, pixelSize);
+            continue;
+        }
+
+        int k0 = (int)u, j0 = (int)v;
+        int k1 = (k0 + 1) % expmapColumns, j1 = (j0 + 1 < expmapRows) ? j0 + 1 : j0;
+        double fu = u - k0, fv = v - j0;
+        const unsigned char *row0 = strip + (size_t)j0 * expmapColumns * pixelSize;
+        const unsigned char *row1 = strip + (size_t)j1 * expmapColumns * pixelSize;
+        int c;
+
+        k0 %= expmapColumns;
+
+        for (c = 0; c < 3; c++)
+        {
+            double top = row0[k0 * pixelSize + c] + fu * (row0[k1 * pixelSize + c] - row0[k0 * pixelSize + c]);
+            double bottom = row1[k0 * pixelSize + c] + fu * (row1[k1 * pixelSize + c] - row1[k0 * pixelSize + c]);
+
+            out[c] = (unsigned char)(top + fv * (bottom - top) + 0.5);
+        }
+    }
+}
+
+#endif
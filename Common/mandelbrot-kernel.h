@@ -0,0 +1,790 @@
+//
+//  mandelbrot-kernel.h
+//
+//
+//  Escape-time kernel shared by the OMP, Hybrid and sequential programs.
+//
+//  Every program iterates z = z*z + c for a run of pixels and keeps, for
+//  each of them, the iteration in which |z| exceeded 2 (or maxIterations
+//  when it never did) and the final |z|^2, which is what the smooth
+//  coloring needs. The run is handed to the widest kernel available on the
+//  node executing the binary:
+//
+//  - AVX-512: 8 pixels per vector, escape tests on mask registers
+//  - AVX2:    4 pixels per vector, escape tests on compare masks
+//  - scalar:  1 pixel at a time, bit-for-bit the original loop
+//
+//  The choice is made once at startup by escapeInit(), so the same binary
+//  runs on every node of the cluster. It can be forced with the
+//  MANDELBROT_ISA environment variable (scalar, avx2 or avx512).
+//
+//  Each instruction set has two kernel modes, chosen with MANDELBROT_KERNEL:
+//
+//  - row:    a vector takes the next 4/8 pixels of the run and iterates
+//            them until the last one escapes
+//  - stream: a lane whose pixel escaped stores its result and loads the
+//            next pending pixel of the run straight away, so lanes do not
+//            sit idle next to a pixel that runs to maxIterations
+//
+//  Both count the lane-iterations they execute, so the lane utilisation of
+//  each mode can be compared on the same image.
+//
+//  Before a run reaches the kernel, the pixels inside the main cardioid,
+//  the period-2 bulb and the largest period-3 and period-4 bulbs are
+//  painted as interior without iterating (MANDELBROT_INTERIOR=0 turns this
+//  pre-check off).
+//
+//  Inside the kernels, an orbit that returns to a previously saved value
+//  of z is periodic and is classified as interior straight away
+//  (MANDELBROT_PERIODICITY=0 turns this check off).
+//
+
+#ifndef MANDELBROT_KERNEL_H
+#define MANDELBROT_KERNEL_H
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mandelbrot-color.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define ESCAPE_X86 1
+#endif
+
+/*---- View ---------------------------------------------------------------*/
+
+// Size of the generated image and the zoom and position of the view
+struct view
+{
+    int w, h;
+    double zoom, moveX, moveY;
+};
+
+// Real part of the pixels in column x
+static inline double pixelRe(const struct view *view, int x)
+{
+    return 1.5 * (x - view->w / 2) / (0.5 * view->zoom * view->w) + view->moveX;
+}
+
+// Imaginary part of the pixels in row y
+static inline double pixelIm(const struct view *view, int y)
+{
+    return (y - view->h / 2) / (0.5 * view->zoom * view->h) + view->moveY;
+}
+
+// Reads the zoom and the center of the view from MANDELBROT_ZOOM, MANDELBROT_CENTER_RE and
+// MANDELBROT_CENTER_IM, when they are set. The center is kept in double here, the perturbation
+// engine reads the same strings in full precision
+static inline void viewInit(struct view *view)
+{
+    const char *zoom = getenv("MANDELBROT_ZOOM");
+    const char *re = getenv("MANDELBROT_CENTER_RE");
+    const char *im = getenv("MANDELBROT_CENTER_IM");
+
+    if (zoom != NULL)
+        view->zoom = strtod(zoom, NULL);
+
+    if (re != NULL)
+        view->moveX = strtod(re, NULL);
+
+    if (im != NULL)
+        view->moveY = strtod(im, NULL);
+}
+
+
+/*---- Kernels ---------------------------------------------------------------*/
+
+// Vector lane-iterations executed by a kernel, how many of them iterated a pending pixel,
+// how many pixels were classified as interior without reaching the kernel,
+// and how many orbits were found to be periodic
+struct escapeStats
+{
+    long long slots, active, interior, cycles;
+};
+
+// Iterates the n points (cr[k], ci[k]), storing for each one the escape iteration and the final |z|^2
+typedef void (*escapeKernel)(const double *cr, const double *ci, int n, int maxIterations, int *iterations, double *norms, struct escapeStats *stats);
+
+// Distance (|dRe| + |dIm|) under which z is taken to have returned to the saved value, 0 disables the check.
+// A few hundred ulps of |z| <= 2: attracting cycles settle well below it in double precision,
+// while an escaping orbit this close to a previous value would need far more than maxIterations to leave
+#define ESCAPE_CYCLE_EPSILON 1e-14
+
+// Periodicity tolerance used by the kernels
+static double escapeCycleEpsilon = ESCAPE_CYCLE_EPSILON;
+
+// Lane-iterations spent on a pixel that escaped after i iterations
+static inline long long escapeCost(int i, int maxIterations)
+{
+    return (i < maxIterations) ? i + 1 : maxIterations;
+}
+
+// Iterates a single point, the squares of z are reused between the escape test and the next iteration
+// z is saved after 1, 2, 4, 8... iterations (Brent's method); an orbit that comes back to the saved
+// value is periodic, so it is classified as interior without running to maxIterations
+static inline int escapePoint(double pr, double pi, int maxIterations, double *norm, struct escapeStats *stats)
+{
+    double re = 0, im = 0, re2 = 0, im2 = 0;
+    double savedRe = 0, savedIm = 0;
+    long long save = 1;
+    int i;
+
+    for (i = 0; i < maxIterations; i++)
+    {
+        im = 2 * re * im + pi;
+        re = re2 - im2 + pr;
+        re2 = re * re;
+        im2 = im * im;
+
+        //if the point is outside the circle with radius 2: stop
+        if ((re2 + im2) > 4)
+            break;
+
+        // the orbit is back where it was: it repeats forever
+        if (fabs(re - savedRe) + fabs(im - savedIm) < escapeCycleEpsilon)
+        {
+            stats->cycles++;
+            stats->slots += i + 1;
+            stats->active += i + 1;
+
+            *norm = re2 + im2;
+            return maxIterations;
+        }
+
+        if (i + 1 == save)
+        {
+            savedRe = re;
+            savedIm = im;
+            save *= 2;
+        }
+    }
+
+    // a scalar lane is never idle
+    stats->slots += escapeCost(i, maxIterations);
+    stats->active += escapeCost(i, maxIterations);
+
+    *norm = re2 + im2;
+    return i;
+}
+
+// Scalar kernel, one pixel at a time
+static void escapeScalar(const double *cr, const double *ci, int n, int maxIterations, int *iterations, double *norms, struct escapeStats *stats)
+{
+    int k;
+
+    for (k = 0; k < n; k++)
+    {
+        iterations[k] = escapePoint(cr[k], ci[k], maxIterations, &norms[k], stats);
+    }
+}
+
+#ifdef ESCAPE_X86
+
+// AVX2 kernel, 4 pixels per vector
+// Lanes that escape or turn out periodic are masked out of the counter and keep the |z|^2 of their last iteration
+__attribute__((target("avx2,fma")))
+static void escapeAVX2(const double *cr, const double *ci, int n, int maxIterations, int *iterations, double *norms, struct escapeStats *stats)
+{
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const __m256d epsilon = _mm256_set1_pd(escapeCycleEpsilon);
+    int k, i, j;
+
+    for (k = 0; k + 4 <= n; k += 4)
+    {
+        __m256d pr = _mm256_loadu_pd(cr + k);
+        __m256d pi = _mm256_loadu_pd(ci + k);
+        __m256d re = _mm256_setzero_pd(), im = re, re2 = re, im2 = re;
+        __m256d savedRe = re, savedIm = re;
+        __m256d norm = re, count = re, cycled = re;
+        __m256d active = _mm256_cmp_pd(re, re, _CMP_EQ_OQ);
+        long long save = 1;
+
+        for (i = 0; i < maxIterations; i++)
+        {
+            im = _mm256_fmadd_pd(_mm256_add_pd(re, re), im, pi);
+            re = _mm256_add_pd(_mm256_sub_pd(re2, im2), pr);
+            re2 = _mm256_mul_pd(re, re);
+            im2 = _mm256_mul_pd(im, im);
+
+            __m256d mag = _mm256_add_pd(re2, im2);
+            __m256d escaped = _mm256_and_pd(_mm256_cmp_pd(mag, four, _CMP_GT_OQ), active);
+
+            // distance to the saved z, for the lanes that did not escape
+            __m256d distance = _mm256_add_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(re, savedRe)),
+                                             _mm256_andnot_pd(sign, _mm256_sub_pd(im, savedIm)));
+            __m256d periodic = _mm256_andnot_pd(escaped, _mm256_and_pd(_mm256_cmp_pd(distance, epsilon, _CMP_LT_OQ), active));
+
+            norm = _mm256_blendv_pd(norm, mag, _mm256_or_pd(escaped, periodic));
+            cycled = _mm256_or_pd(cycled, periodic);
+            active = _mm256_andnot_pd(_mm256_or_pd(escaped, periodic), active);
+
+            if (_mm256_movemask_pd(active) == 0)
+                break;
+
+            count = _mm256_add_pd(count, _mm256_and_pd(active, one));
+
+            if (i + 1 == save)
+            {
+                savedRe = re;
+                savedIm = im;
+                save *= 2;
+            }
+        }
+
+        // lanes that never escaped keep the last |z|^2
+        norm = _mm256_blendv_pd(norm, _mm256_add_pd(re2, im2), active);
+
+        _mm_storeu_si128((__m128i *)(iterations + k), _mm256_cvtpd_epi32(count));
+        _mm256_storeu_pd(norms + k, norm);
+
+        // the vector ran until its last lane finished
+        stats->slots += 4 * escapeCost(i, maxIterations);
+
+        for (j = 0; j < 4; j++)
+        {
+            stats->active += escapeCost(iterations[k + j], maxIterations);
+
+            // periodic lanes belong to the set
+            if ((_mm256_movemask_pd(cycled) >> j) & 1)
+            {
+                iterations[k + j] = maxIterations;
+                stats->cycles++;
+            }
+        }
+    }
+
+    // remaining pixels of the run
+    escapeScalar(cr + k, ci + k, n - k, maxIterations, iterations + k, norms + k, stats);
+}
+
+// AVX-512 kernel, 8 pixels per vector
+// The tail of the run is loaded with a partial mask instead of falling back to scalar code
+__attribute__((target("avx512f")))
+static void escapeAVX512(const double *cr, const double *ci, int n, int maxIterations, int *iterations, double *norms, struct escapeStats *stats)
+{
+    const __m512d four = _mm512_set1_pd(4.0);
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d epsilon = _mm512_set1_pd(escapeCycleEpsilon);
+    int counts[8];
+    int k, i, j;
+
+    for (k = 0; k < n; k += 8)
+    {
+        __mmask8 lanes = (n - k >= 8) ? 0xFF : (__mmask8)((1u << (n - k)) - 1);
+        __m512d pr = _mm512_maskz_loadu_pd(lanes, cr + k);
+        __m512d pi = _mm512_maskz_loadu_pd(lanes, ci + k);
+        __m512d re = _mm512_setzero_pd(), im = re, re2 = re, im2 = re;
+        __m512d savedRe = re, savedIm = re;
+        __m512d norm = re, count = re;
+        __mmask8 active = lanes, cycled = 0;
+        long long save = 1;
+
+        for (i = 0; i < maxIterations; i++)
+        {
+            im = _mm512_fmadd_pd(_mm512_add_pd(re, re), im, pi);
+            re = _mm512_add_pd(_mm512_sub_pd(re2, im2), pr);
+            re2 = _mm512_mul_pd(re, re);
+            im2 = _mm512_mul_pd(im, im);
+
+            __m512d mag = _mm512_add_pd(re2, im2);
+            __mmask8 escaped = _mm512_mask_cmp_pd_mask(active, mag, four, _CMP_GT_OQ);
+
+            // distance to the saved z, for the lanes that did not escape
+            __m512d distance = _mm512_add_pd(_mm512_abs_pd(_mm512_sub_pd(re, savedRe)),
+                                             _mm512_abs_pd(_mm512_sub_pd(im, savedIm)));
+            __mmask8 periodic = _mm512_mask_cmp_pd_mask(active & ~escaped, distance, epsilon, _CMP_LT_OQ);
+
+            norm = _mm512_mask_mov_pd(norm, escaped | periodic, mag);
+            cycled |= periodic;
+            active &= ~(escaped | periodic);
+
+            if (active == 0)
+                break;
+
+            count = _mm512_mask_add_pd(count, active, count, one);
+
+            if (i + 1 == save)
+            {
+                savedRe = re;
+                savedIm = im;
+                save *= 2;
+            }
+        }
+
+        // lanes that never escaped keep the last |z|^2
+        norm = _mm512_mask_add_pd(norm, active, re2, im2);
+
+        // AVX-512F has no masked 256-bit integer store, the counters go through the stack
+        _mm256_storeu_si256((__m256i *)counts, _mm512_cvtpd_epi32(count));
+        _mm512_mask_storeu_pd(norms + k, lanes, norm);
+
+        // the vector ran until its last lane finished
+        stats->slots += 8 * escapeCost(i, maxIterations);
+
+        for (j = 0; j < 8 && k + j < n; j++)
+        {
+            stats->active += escapeCost(counts[j], maxIterations);
+
+            // periodic lanes belong to the set
+            if ((cycled >> j) & 1)
+            {
+                counts[j] = maxIterations;
+                stats->cycles++;
+            }
+        }
+
+        memcpy(iterations + k, counts, sizeof(int) * ((n - k < 8) ? n - k : 8));
+    }
+}
+
+// Mask vector with the lanes set in bits
+__attribute__((target("avx2")))
+static inline __m256d laneMaskAVX2(int bits)
+{
+    const __m256i select = _mm256_set_epi64x(8, 4, 2, 1);
+    __m256i set = _mm256_and_si256(_mm256_set1_epi64x(bits), select);
+
+    return _mm256_castsi256_pd(_mm256_cmpeq_epi64(set, select));
+}
+
+// AVX2 stream kernel, 4 lanes fed from the run
+// Finished lanes are refilled with a masked gather and their state is reset to z = 0
+// Each lane saves z on its own schedule, after 1, 2, 4, 8... iterations of its current pixel
+__attribute__((target("avx2,fma")))
+static void streamAVX2(const double *cr, const double *ci, int n, int maxIterations, int *iterations, double *norms, struct escapeStats *stats)
+{
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const __m256d epsilon = _mm256_set1_pd(escapeCycleEpsilon);
+    const __m256d limit = _mm256_set1_pd((double)maxIterations);
+
+    // pixel iterated by each lane, -1 when the run has no pixels left for it
+    int lane[4];
+    double mags[4], counts[4];
+    int next = 0, active = 0, refill = 0xF, j;
+
+    __m256d pr = _mm256_setzero_pd(), pi = pr, re = pr, im = pr, re2 = pr, im2 = pr, count = pr;
+    __m256d savedRe = pr, savedIm = pr, save = one;
+
+    for (;;)
+    {
+        // loads the next pending pixels into the lanes that finished
+        if (refill)
+        {
+            for (j = 0; j < 4; j++)
+            {
+                if ((refill >> j) & 1)
+                {
+                    lane[j] = (next < n) ? next++ : -1;
+                    active |= (lane[j] >= 0) << j;
+                }
+            }
+
+            __m256d reset = laneMaskAVX2(refill);
+            __m256d loaded = laneMaskAVX2(refill & active);
+            __m128i index = _mm_loadu_si128((const __m128i *)lane);
+
+            pr = _mm256_mask_i32gather_pd(pr, cr, index, loaded, 8);
+            pi = _mm256_mask_i32gather_pd(pi, ci, index, loaded, 8);
+            re = _mm256_andnot_pd(reset, re);
+            im = _mm256_andnot_pd(reset, im);
+            re2 = _mm256_andnot_pd(reset, re2);
+            im2 = _mm256_andnot_pd(reset, im2);
+            count = _mm256_andnot_pd(reset, count);
+            savedRe = _mm256_andnot_pd(reset, savedRe);
+            savedIm = _mm256_andnot_pd(reset, savedIm);
+            save = _mm256_blendv_pd(save, one, reset);
+
+            if (active == 0)
+                break;
+        }
+
+        __m256d running = laneMaskAVX2(active);
+
+        im = _mm256_fmadd_pd(_mm256_add_pd(re, re), im, pi);
+        re = _mm256_add_pd(_mm256_sub_pd(re2, im2), pr);
+        re2 = _mm256_mul_pd(re, re);
+        im2 = _mm256_mul_pd(im, im);
+        count = _mm256_add_pd(count, _mm256_and_pd(running, one));
+
+        __m256d mag = _mm256_add_pd(re2, im2);
+        __m256d distance = _mm256_add_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(re, savedRe)),
+                                         _mm256_andnot_pd(sign, _mm256_sub_pd(im, savedIm)));
+
+        int escaped = _mm256_movemask_pd(_mm256_cmp_pd(mag, four, _CMP_GT_OQ)) & active;
+        int periodic = _mm256_movemask_pd(_mm256_cmp_pd(distance, epsilon, _CMP_LT_OQ)) & active & ~escaped;
+        int exhausted = _mm256_movemask_pd(_mm256_cmp_pd(count, limit, _CMP_GE_OQ)) & active;
+
+        // lanes that reached their saving point keep z and double the interval
+        __m256d saving = _mm256_cmp_pd(count, save, _CMP_EQ_OQ);
+
+        savedRe = _mm256_blendv_pd(savedRe, re, saving);
+        savedIm = _mm256_blendv_pd(savedIm, im, saving);
+        save = _mm256_add_pd(save, _mm256_and_pd(saving, save));
+
+        stats->slots += 4;
+        stats->active += __builtin_popcount(active);
+        stats->cycles += __builtin_popcount(periodic);
+
+        refill = escaped | periodic | exhausted;
+
+        // stores the result of the lanes that finished
+        if (refill)
+        {
+            _mm256_storeu_pd(mags, mag);
+            _mm256_storeu_pd(counts, count);
+
+            for (j = 0; j < 4; j++)
+            {
+                if ((refill >> j) & 1)
+                {
+                    iterations[lane[j]] = ((escaped >> j) & 1) ? (int)counts[j] - 1 : maxIterations;
+                    norms[lane[j]] = mags[j];
+                }
+            }
+
+            active &= ~refill;
+        }
+    }
+}
+
+// AVX-512 stream kernel, 8 lanes fed from the run
+// Finished lanes are refilled with a masked gather and their state is reset to z = 0
+// Each lane saves z on its own schedule, after 1, 2, 4, 8... iterations of its current pixel
+__attribute__((target("avx512f")))
+static void streamAVX512(const double *cr, const double *ci, int n, int maxIterations, int *iterations, double *norms, struct escapeStats *stats)
+{
+    const __m512d four = _mm512_set1_pd(4.0);
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d epsilon = _mm512_set1_pd(escapeCycleEpsilon);
+    const __m512d limit = _mm512_set1_pd((double)maxIterations);
+
+    // pixel iterated by each lane, -1 when the run has no pixels left for it
+    int lane[8];
+    double mags[8], counts[8];
+    int next = 0, j;
+    __mmask8 active = 0, refill = 0xFF;
+
+    __m512d pr = _mm512_setzero_pd(), pi = pr, re = pr, im = pr, re2 = pr, im2 = pr, count = pr;
+    __m512d savedRe = pr, savedIm = pr, save = one;
+
+    for (;;)
+    {
+        // loads the next pending pixels into the lanes that finished
+        if (refill)
+        {
+            for (j = 0; j < 8; j++)
+            {
+                if ((refill >> j) & 1)
+                {
+                    lane[j] = (next < n) ? next++ : -1;
+                    active |= (lane[j] >= 0) << j;
+                }
+            }
+
+            __m256i index = _mm256_loadu_si256((const __m256i *)lane);
+
+            pr = _mm512_mask_i32gather_pd(pr, refill & active, index, cr, 8);
+            pi = _mm512_mask_i32gather_pd(pi, refill & active, index, ci, 8);
+            re = _mm512_maskz_mov_pd(~refill, re);
+            im = _mm512_maskz_mov_pd(~refill, im);
+            re2 = _mm512_maskz_mov_pd(~refill, re2);
+            im2 = _mm512_maskz_mov_pd(~refill, im2);
+            count = _mm512_maskz_mov_pd(~refill, count);
+            savedRe = _mm512_maskz_mov_pd(~refill, savedRe);
+            savedIm = _mm512_maskz_mov_pd(~refill, savedIm);
+            save = _mm512_mask_mov_pd(save, refill, one);
+
+            if (active == 0)
+                break;
+        }
+
+        im = _mm512_fmadd_pd(_mm512_add_pd(re, re), im, pi);
+        re = _mm512_add_pd(_mm512_sub_pd(re2, im2), pr);
+        re2 = _mm512_mul_pd(re, re);
+        im2 = _mm512_mul_pd(im, im);
+        count = _mm512_mask_add_pd(count, active, count, one);
+
+        __m512d mag = _mm512_add_pd(re2, im2);
+        __m512d distance = _mm512_add_pd(_mm512_abs_pd(_mm512_sub_pd(re, savedRe)),
+                                         _mm512_abs_pd(_mm512_sub_pd(im, savedIm)));
+
+        __mmask8 escaped = _mm512_mask_cmp_pd_mask(active, mag, four, _CMP_GT_OQ);
+        __mmask8 periodic = _mm512_mask_cmp_pd_mask(active & ~escaped, distance, epsilon, _CMP_LT_OQ);
+        __mmask8 exhausted = _mm512_mask_cmp_pd_mask(active, count, limit, _CMP_GE_OQ);
+
+        // lanes that reached their saving point keep z and double the interval
+        __mmask8 saving = _mm512_cmp_pd_mask(count, save, _CMP_EQ_OQ);
+
+        savedRe = _mm512_mask_mov_pd(savedRe, saving, re);
+        savedIm = _mm512_mask_mov_pd(savedIm, saving, im);
+        save = _mm512_mask_add_pd(save, saving, save, save);
+
+        stats->slots += 8;
+        stats->active += __builtin_popcount(active);
+        stats->cycles += __builtin_popcount(periodic);
+
+        refill = escaped | periodic | exhausted;
+
+        // stores the result of the lanes that finished
+        if (refill)
+        {
+            _mm512_storeu_pd(mags, mag);
+            _mm512_storeu_pd(counts, count);
+
+            for (j = 0; j < 8; j++)
+            {
+                if ((refill >> j) & 1)
+                {
+                    iterations[lane[j]] = ((escaped >> j) & 1) ? (int)counts[j] - 1 : maxIterations;
+                    norms[lane[j]] = mags[j];
+                }
+            }
+
+            active &= ~refill;
+        }
+    }
+}
+
+#endif
+
+
+/*---- Interior ---------------------------------------------------------------*/
+
+// Bulbs of period 3 and 4 tested with a disc inscribed in them: centre and squared radius.
+// The discs were fitted to the boundary of each component (|multiplier| = 1) and shrunk by 3%,
+// the lower bulbs are the mirror image of the upper ones and are tested with |pi|.
+static const double interiorDiscs[3][3] = {
+    {-0.1249127299, 0.7439211414, 0.0915 * 0.0915}, // period 3, top of the main cardioid
+    {0.2809584074, 0.5311547704, 0.0425 * 0.0425},  // period 4, right of the period 3 bulb
+    {-1.3089367534, 0.0, 0.057 * 0.057}             // period 4, left of the period 2 bulb
+};
+
+// Closed-form membership test: the point belongs to the set, so it would run to maxIterations
+static inline int escapeInterior(double pr, double pi)
+{
+    double pi2 = pi * pi;
+    double q = (pr - 0.25) * (pr - 0.25) + pi2;
+    double api = fabs(pi);
+    int d;
+
+    // main cardioid
+    if (q * (q + (pr - 0.25)) <= 0.25 * pi2)
+        return 1;
+
+    // period 2 bulb, the disc of radius 1/4 centred at -1
+    if ((pr + 1) * (pr + 1) + pi2 <= 0.0625)
+        return 1;
+
+    for (d = 0; d < 3; d++)
+    {
+        double dr = pr - interiorDiscs[d][0];
+        double di = api - interiorDiscs[d][1];
+
+        if (dr * dr + di * di <= interiorDiscs[d][2])
+            return 1;
+    }
+
+    return 0;
+}
+
+
+/*---- Dispatch ---------------------------------------------------------------*/
+
+// Kernel selected by escapeInit
+static escapeKernel escapeRun = escapeScalar;
+
+// Name of the selected instruction set and kernel mode, reported with the execution time
+static const char *escapeIsa = "scalar";
+static const char *escapeMode = "row";
+
+// Whether the interior pre-check runs before the kernel
+static int escapeCheckInterior = 1;
+
+// Lane-iterations of every run iterated by this process
+static struct escapeStats escapeTotals;
+
+// Selects the widest kernel supported by this node, unless MANDELBROT_ISA forces one
+// MANDELBROT_KERNEL=stream selects the lane-refill kernels instead of the row ones
+static void escapeInit(void)
+{
+    const char *forced = getenv("MANDELBROT_ISA");
+    const char *mode = getenv("MANDELBROT_KERNEL");
+    const char *interior = getenv("MANDELBROT_INTERIOR");
+    const char *periodicity = getenv("MANDELBROT_PERIODICITY");
+    int stream = (mode != NULL && strcmp(mode, "stream") == 0);
+
+    escapeCheckInterior = (interior == NULL || strcmp(interior, "0") != 0);
+    escapeCycleEpsilon = (periodicity == NULL || strcmp(periodicity, "0") != 0) ? ESCAPE_CYCLE_EPSILON : 0;
+
+    escapeRun = escapeScalar;
+    escapeIsa = "scalar";
+
+    // the scalar kernel has no stream mode, the mode is reported only where a stream kernel is installed
+    escapeMode = "row";
+
+#ifdef ESCAPE_X86
+    __builtin_cpu_init();
+
+    int avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+
+    // the AVX-512 nodes also run the AVX2 kernels of the other precisions, which need their own check
+    int avx512 = __builtin_cpu_supports("avx512f") && avx2;
+
+    if (forced != NULL && strcmp(forced, "scalar") == 0)
+    {
+        avx512 = avx2 = 0;
+    }
+    else if (forced != NULL && strcmp(forced, "avx2") == 0)
+    {
+        avx512 = 0;
+    }
+
+    if (avx512)
+    {
+        escapeRun = stream ? streamAVX512 : escapeAVX512;
+        escapeMode = stream ? "stream" : "row";
+        escapeIsa = "avx512";
+    }
+    else if (avx2)
+    {
+        escapeRun = stream ? streamAVX2 : escapeAVX2;
+        escapeMode = stream ? "stream" : "row";
+        escapeIsa = "avx2";
+    }
+#else
+    (void)forced;
+    (void)stream;
+#endif
+}
+
+// Percentage of the executed lane-iterations that iterated a pending pixel
+static inline double escapeUtilisation(const struct escapeStats *stats)
+{
+    return (stats->slots > 0) ? 100.0 * stats->active / stats->slots : 100.0;
+}
+
+
+/*---- Work ---------------------------------------------------------------*/
+
+// Per-thread buffers of a run of pixels: their coordinates, and the escape iteration and final |z|^2 of each one
+// crLo and ciLo hold the low parts of the coordinates for the extended precision kernels (mandelbrot-precision.h)
+struct escapeWork
+{
+    double *cr, *ci;
+    double *crLo, *ciLo;
+    int *iterations;
+    double *norms;
+    int *index;
+    struct escapeStats stats;
+};
+
+// Allocates the buffers of a run of up to capacity pixels
+static void escapeWorkInit(struct escapeWork *work, int capacity)
+{
+    work->cr = malloc(sizeof(double) * capacity);
+    work->ci = malloc(sizeof(double) * capacity);
+    work->crLo = malloc(sizeof(double) * capacity);
+    work->ciLo = malloc(sizeof(double) * capacity);
+    work->iterations = malloc(sizeof(int) * capacity);
+    work->norms = malloc(sizeof(double) * capacity);
+    work->index = malloc(sizeof(int) * capacity);
+    work->stats.slots = work->stats.active = work->stats.interior = work->stats.cycles = 0;
+}
+
+// Deallocates the buffers, adding the lane-iterations of this thread to the process totals
+static void escapeWorkFree(struct escapeWork *work)
+{
+    #pragma omp atomic
+    escapeTotals.slots += work->stats.slots;
+
+    #pragma omp atomic
+    escapeTotals.active += work->stats.active;
+
+    #pragma omp atomic
+    escapeTotals.interior += work->stats.interior;
+
+    #pragma omp atomic
+    escapeTotals.cycles += work->stats.cycles;
+
+    free(work->cr);
+    free(work->ci);
+    free(work->crLo);
+    free(work->ciLo);
+    free(work->iterations);
+    free(work->norms);
+    free(work->index);
+}
+
+// Iterates the first n pixels of the run, whose coordinates are already in work->cr and work->ci
+// The pixels that pass the interior pre-check are removed from the coordinates before the kernel runs,
+// so work->cr and work->ci do not keep their values. kernel iterates the pixels left
+static void escapePointsWith(struct escapeWork *work, int n, int maxIterations, escapeKernel kernel)
+{
+    int k, j, m = 0;
+
+    if (!escapeCheckInterior)
+    {
+        kernel(work->cr, work->ci, n, maxIterations, work->iterations, work->norms, &work->stats);
+        return;
+    }
+
+    // moves the pixels that still have to be iterated to the front of the run
+    for (k = 0; k < n; k++)
+    {
+        if (!escapeInterior(work->cr[k], work->ci[k]))
+        {
+            work->cr[m] = work->cr[k];
+            work->ci[m] = work->ci[k];
+            work->index[m++] = k;
+        }
+    }
+
+    work->stats.interior += n - m;
+
+    kernel(work->cr, work->ci, m, maxIterations, work->iterations, work->norms, &work->stats);
+
+    // spreads the results back to their pixels, from the end so none is overwritten before it is moved
+    for (k = n - 1, j = m - 1; k >= 0; k--)
+    {
+        if (j >= 0 && work->index[j] == k)
+        {
+            work->iterations[k] = work->iterations[j];
+            work->norms[k] = work->norms[j];
+            j--;
+        }
+        else
+        {
+            work->iterations[k] = maxIterations;
+            work->norms[k] = 0;
+        }
+    }
+}
+
+// Iterates the first n pixels of the run with the kernel selected by escapeInit
+static void escapePoints(struct escapeWork *work, int n, int maxIterations)
+{
+    escapePointsWith(work, n, maxIterations, escapeRun);
+}
+
+// Iterates the n pixels of row y starting at column x0, the whole row is the pixel queue of the stream kernel
+static void escapeRow(const struct view *view, int y, int x0, int n, int maxIterations, struct escapeWork *work)
+{
+    double pi = pixelIm(view, y);
+    int k;
+
+    for (k = 0; k < n; k++)
+    {
+        work->cr[k] = pixelRe(view, x0 + k);
+        work->ci[k] = pi;
+    }
+
+    escapePoints(work, n, maxIterations);
+}
+
+#endif
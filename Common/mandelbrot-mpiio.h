@@ -0,0 +1,172 @@
+//
+//  mandelbrot-mpiio.h
+//
+//
+//  Parallel output of the hybrid programs with MPI-IO, selected with
+//  MANDELBROT_WRITER=mpiio and the path of the image in MANDELBROT_FILE.
+//
+//  Instead of sending its pixels to rank 0, every process keeps the rows
+//  (or tiles) it calculated and lists them as blocks: a run of pixels and
+//  its position in the image. Once the image is complete, every process
+//  opens the file, rank 0 writes the header, and each process writes its
+//  blocks with one MPI_File_write_at_all:
+//
+//  - the file view skips the header and every pixel of the other
+//    processes (an hindexed type over the blocks, sorted by position)
+//  - the memory type picks the blocks from wherever they were calculated
+//
+//  so the pixels never travel to rank 0, and the MPI-IO layer can merge
+//  the writes of all the processes into large requests.
+//
+
+#ifndef MANDELBROT_MPIIO_H
+#define MANDELBROT_MPIIO_H
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mandelbrot-output.h"
+
+// Run of pixels calculated by this process: its first pixel in the image, its number of pixels, where it is,
+// and whether data is the start of a buffer to be freed with the blocks
+struct mpiioBlock
+{
+    long long pixel;
+    int count;
+    void *data;
+    int owned;
+};
+
+// Blocks calculated by this process
+static struct mpiioBlock *mpiioBlocks = NULL;
+static int mpiioCount = 0, mpiioCapacity = 0;
+
+// Whether MANDELBROT_WRITER=mpiio and MANDELBROT_FILE names the image
+static int mpiioSelected(void)
+{
+    const char *writer = getenv("MANDELBROT_WRITER");
+
+    return writer != NULL && strcmp(writer, "mpiio") == 0 && getenv("MANDELBROT_FILE") != NULL;
+}
+
+// Adds the th rows of tw pixels of data, consecutive, which go to (x0, y0) of an image w pixels wide
+// Can be called from several threads at once; data, allocated with malloc, is written by mpiioWrite and freed by mpiioFree
+static void mpiioAddRect(void *data, size_t pixelSize, int x0, int y0, int tw, int th, int w)
+{
+    int row;
+
+    #pragma omp critical (mpiio)
+    {
+        if (mpiioCount + th > mpiioCapacity)
+        {
+            mpiioCapacity = (mpiioCount + th) * 2;
+            mpiioBlocks = realloc(mpiioBlocks, sizeof(struct mpiioBlock) * mpiioCapacity);
+        }
+
+        // the rows of a band follow each other in the image too, they are a single block
+        if (tw == w)
+        {
+            mpiioBlocks[mpiioCount++] = (struct mpiioBlock){(long long)y0 * w, tw * th, data, 1};
+        }
+
+        else
+        {
+            for (row = 0; row < th; row++)
+                mpiioBlocks[mpiioCount++] = (struct mpiioBlock){(long long)(y0 + row) * w + x0, tw, (char *)data + (size_t)row * tw * pixelSize, row == 0};
+        }
+    }
+}
+
+// Orders two blocks by their position in the image, for qsort
+static int mpiioCompare(const void *a, const void *b)
+{
+    long long pa = ((const struct mpiioBlock *)a)->pixel, pb = ((const struct mpiioBlock *)b)->pixel;
+
+    return (pa > pb) - (pa < pb);
+}
+
+// Writes the header (rank 0) and the blocks of every process to MANDELBROT_FILE, an image of pixels pixels of type
+// pixelType, pixelSize bytes each. Collective: every process of MPI_COMM_WORLD calls it, with or without blocks.
+// On rank 0, the writer counts the whole file and the time of the slowest process
+static void mpiioWrite(const char *header, MPI_Datatype pixelType, size_t pixelSize, long long pixels)
+{
+    MPI_Offset headerSize = strlen(header);
+    MPI_Aint *memory = malloc(sizeof(MPI_Aint) * (mpiioCount + 1));
+    MPI_Aint *file = malloc(sizeof(MPI_Aint) * (mpiioCount + 1));
+    int *counts = malloc(sizeof(int) * (mpiioCount + 1));
+    MPI_Datatype memoryType, fileType;
+    MPI_File fh;
+    double begin = outputClock(), seconds;
+    int rank, b;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (MPI_File_open(MPI_COMM_WORLD, getenv("MANDELBROT_FILE"), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+    {
+        if (rank == 0)
+            fprintf(stderr, "Error opening %s\n", getenv("MANDELBROT_FILE"));
+
+        free(memory);
+        free(file);
+        free(counts);
+        return;
+    }
+
+    // a longer file left from an earlier image is cut
+    MPI_File_set_size(fh, headerSize + (MPI_Offset)pixelSize * pixels);
+
+    if (rank == 0)
+        MPI_File_write_at(fh, 0, header, (int)headerSize, MPI_CHAR, MPI_STATUS_IGNORE);
+
+    // the file view takes the blocks in the order they have in the file
+    qsort(mpiioBlocks, mpiioCount, sizeof(struct mpiioBlock), mpiioCompare);
+
+    for (b = 0; b < mpiioCount; b++)
+    {
+        MPI_Get_address(mpiioBlocks[b].data, &memory[b]);
+        file[b] = (MPI_Aint)(mpiioBlocks[b].pixel * pixelSize);
+        counts[b] = mpiioBlocks[b].count;
+    }
+
+    MPI_Type_create_hindexed(mpiioCount, counts, memory, pixelType, &memoryType);
+    MPI_Type_create_hindexed(mpiioCount, counts, file, pixelType, &fileType);
+    MPI_Type_commit(&memoryType);
+    MPI_Type_commit(&fileType);
+
+    MPI_File_set_view(fh, headerSize, pixelType, fileType, "native", MPI_INFO_NULL);
+    MPI_File_write_at_all(fh, 0, MPI_BOTTOM, 1, memoryType, MPI_STATUS_IGNORE);
+
+    MPI_File_close(&fh);
+
+    MPI_Type_free(&memoryType);
+    MPI_Type_free(&fileType);
+    free(memory);
+    free(file);
+    free(counts);
+
+    // the image is complete when the slowest process is done
+    seconds = outputClock() - begin;
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : &seconds, &seconds, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    outputMethod = "MPI-IO";
+    outputBytes += headerSize + (long long)pixelSize * pixels;
+    outputSeconds += seconds;
+}
+
+// Frees the blocks and the buffers they point into
+static void mpiioFree(void)
+{
+    int b;
+
+    for (b = 0; b < mpiioCount; b++)
+        if (mpiioBlocks[b].owned)
+            free(mpiioBlocks[b].data);
+
+    free(mpiioBlocks);
+    mpiioBlocks = NULL;
+    mpiioCount = mpiioCapacity = 0;
+}
+
+#endif
@@ -0,0 +1,357 @@
+//
+//  mandelbrot-output.h
+//
+//
+//  Image writer shared by the OMP, Hybrid and sequential programs.
+//
+//  The programs convert their pixels into one contiguous buffer of
+//  R, G, B bytes (in parallel, one OpenMP iteration per row) and hand it,
+//  together with the PPM header, to outputImage(). The header and the
+//  pixels leave in a few large writev calls instead of three fputc calls
+//  per pixel.
+//
+//  When the output is a pipe (e.g. the image is compressed on the fly),
+//  the pixels are spliced into it with vmsplice, so their pages are handed
+//  to the pipe instead of being copied. The pipe may still reference those
+//  pages after outputImage returns, so the buffer must not be written
+//  again; the programs only free it before exiting.
+//
+//  The frames of an animation reuse their buffers, so outputFrame()
+//  always copies them.
+//
+//  A program that does not keep the whole image can stream it instead:
+//  outputStreamStart() writes the header, and outputStreamRect() writes
+//  each rectangle of pixels at its offset with pwrite, from any thread and
+//  in any order. The image goes to the file named by MANDELBROT_FILE, or
+//  to stdout when it is a regular file (under mpirun, stdout is a pipe).
+//
+//  A program can also calculate its pixels straight into the output:
+//  outputMapStart() sizes the file, maps it into memory, writes the header
+//  and returns where the pixels go; the page cache writes them back in the
+//  background, and outputMapEnd() unmaps the file.
+//
+//  outputImage(), outputFrame() and outputStreamRect() count the bytes they
+//  wrote and the time they spent, which the programs report as the
+//  throughput of the writer.
+//
+
+#ifndef MANDELBROT_OUTPUT_H
+#define MANDELBROT_OUTPUT_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+// Largest number of bytes handed to a single writev or vmsplice call
+#define OUTPUT_CHUNK (1 << 30)
+
+// Bytes written and seconds spent by outputImage
+static long long outputBytes = 0;
+static double outputSeconds = 0;
+
+// System call used for the last image: "writev", "vmsplice" or "pwrite"
+static const char *outputMethod = "writev";
+
+// File of a streamed image, offset of its first pixel and size of its pixels
+static int outputStreamFd = -1;
+static off_t outputStreamBase = 0;
+static size_t outputStreamSize = 0;
+
+// Seconds elapsed since an arbitrary point, used to time the writer
+static double outputClock(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Writes the count buffers of iov to fd, spliced into it when splice is set
+// Returns 0, or -1 with errno set when the system call failed
+static int outputVector(int fd, struct iovec *iov, int count, int splice)
+{
+    while (count > 0)
+    {
+        // sends at most OUTPUT_CHUNK bytes per call
+        struct iovec chunk[2];
+        size_t total = 0;
+        int n = 0;
+        ssize_t done;
+
+        while (n < count && n < 2 && total < OUTPUT_CHUNK)
+        {
+            chunk[n] = iov[n];
+
+            if (chunk[n].iov_len > OUTPUT_CHUNK - total)
+                chunk[n].iov_len = OUTPUT_CHUNK - total;
+
+            total += chunk[n].iov_len;
+            n++;
+        }
+
+#ifdef SYS_vmsplice
+        if (splice)
+            done = syscall(SYS_vmsplice, fd, chunk, (unsigned long)n, 0UL);
+        else
+#endif
+            done = writev(fd, chunk, n);
+
+        if (done < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return -1;
+        }
+
+        outputBytes += done;
+
+        // skips what was written, the call may have stopped part-way through a buffer
+        while (count > 0 && (size_t)done >= iov->iov_len)
+        {
+            done -= iov->iov_len;
+            iov->iov_len = 0;
+            iov++;
+            count--;
+        }
+
+        if (count > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+
+    return 0;
+}
+
+// Writes the PPM header followed by size bytes of pixels to stdout
+static void outputImage(const char *header, const unsigned char *bytes, size_t size)
+{
+    struct iovec iov[2] = {{(void *)header, strlen(header)}, {(void *)bytes, size}};
+    struct stat info;
+    double begin = outputClock();
+    int splice = 0, failed;
+
+    // anything already printed through stdio goes first
+    fflush(stdout);
+
+#ifdef SYS_vmsplice
+    splice = fstat(STDOUT_FILENO, &info) == 0 && S_ISFIFO(info.st_mode);
+#else
+    (void)info;
+#endif
+
+    outputMethod = splice ? "vmsplice" : "writev";
+
+    // the header is copied, only the pixels are handed to the pipe
+    if (splice)
+    {
+        failed = outputVector(STDOUT_FILENO, iov, 1, 0) || outputVector(STDOUT_FILENO, iov + 1, 1, 1);
+
+        // vmsplice is not available for this pipe, the bytes left are copied instead
+        if (failed && (errno == EINVAL || errno == ENOSYS))
+        {
+            outputMethod = "writev";
+            failed = outputVector(STDOUT_FILENO, iov, 2, 0);
+        }
+    }
+
+    else
+        failed = outputVector(STDOUT_FILENO, iov, 2, 0);
+
+    if (failed)
+        perror("Error writing the image");
+
+    outputSeconds += outputClock() - begin;
+}
+
+// Writes a header followed by size bytes to stdout, always copied, for buffers that are written again afterwards
+static inline void outputFrame(const char *header, const unsigned char *bytes, size_t size)
+{
+    struct iovec iov[2] = {{(void *)header, strlen(header)}, {(void *)bytes, size}};
+    double begin = outputClock();
+
+    fflush(stdout);
+
+    if (outputVector(STDOUT_FILENO, iov, 2, 0))
+        perror("Error writing the frame");
+
+    outputSeconds += outputClock() - begin;
+}
+
+// Writes the header of an image of size bytes of pixels to MANDELBROT_FILE or stdout, whose pixels are then written
+// with outputStreamRect. Returns 0, or -1 when the file cannot be opened or stdout is not a regular file (the image
+// has to be written with outputImage)
+static inline int outputStreamStart(const char *header, size_t size)
+{
+    const char *path = getenv("MANDELBROT_FILE");
+    struct stat info;
+    struct iovec iov = {(void *)header, strlen(header)};
+    off_t start = 0;
+
+    fflush(stdout);
+
+    if (path != NULL)
+    {
+        outputStreamFd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if (outputStreamFd < 0)
+        {
+            perror(path);
+            return -1;
+        }
+    }
+
+    else if (fstat(STDOUT_FILENO, &info) == 0 && S_ISREG(info.st_mode) && (start = lseek(STDOUT_FILENO, 0, SEEK_CUR)) >= 0)
+        outputStreamFd = STDOUT_FILENO;
+
+    else
+        return -1;
+
+    outputMethod = "pwrite";
+    outputStreamBase = start + iov.iov_len;
+    outputStreamSize = size;
+
+    if (lseek(outputStreamFd, start, SEEK_SET) < 0 || outputVector(outputStreamFd, &iov, 1, 0))
+        perror("Error writing the image");
+
+    return 0;
+}
+
+// Writes a rectangle of rows pixel rows of width bytes each, consecutive in bytes, at byte offset of the pixels of a
+// streamed image whose rows are stride bytes apart. Can be called from several threads at once
+static inline void outputStreamRect(size_t offset, const unsigned char *bytes, size_t width, int rows, size_t stride)
+{
+    double begin = outputClock();
+    int row;
+
+    for (row = 0; row < rows; row++)
+    {
+        const unsigned char *data = bytes + (size_t)row * width;
+        off_t at = outputStreamBase + offset + (size_t)row * stride;
+        size_t left = width;
+
+        while (left > 0)
+        {
+            ssize_t done = pwrite(outputStreamFd, data, left, at);
+
+            if (done < 0 && errno == EINTR)
+                continue;
+
+            if (done < 0)
+            {
+                perror("Error writing the image");
+                return;
+            }
+
+            data += done;
+            at += done;
+            left -= done;
+        }
+    }
+
+    #pragma omp atomic
+    outputBytes += (long long)width * rows;
+
+    #pragma omp atomic
+    outputSeconds += outputClock() - begin;
+}
+
+// Closes the file of the streamed image, or leaves the position of stdout after it, which pwrite did not move
+static inline void outputStreamEnd(void)
+{
+    if (outputStreamFd != STDOUT_FILENO)
+        close(outputStreamFd);
+    else
+        lseek(STDOUT_FILENO, outputStreamBase + outputStreamSize, SEEK_SET);
+}
+
+// File of the output mapped into memory, its length, and where stdout continues after the image (-1 for MANDELBROT_FILE)
+static unsigned char *outputMap = NULL;
+static size_t outputMapLength = 0;
+static off_t outputMapAfter = -1;
+
+// Creates the output, MANDELBROT_FILE or stdout when it is a regular file, with the header and size bytes of pixels,
+// maps it into memory and returns where the pixels go, or NULL when the output cannot be mapped
+static inline unsigned char *outputMapStart(const char *header, size_t size)
+{
+    const char *path = getenv("MANDELBROT_FILE");
+    size_t length = strlen(header);
+    double begin = outputClock();
+    struct stat info;
+    off_t start = 0, base;
+    int fd;
+
+    fflush(stdout);
+
+    if (path != NULL)
+        fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    // stdout is opened again, the mapping needs to read the file too
+    else if (fstat(STDOUT_FILENO, &info) == 0 && S_ISREG(info.st_mode) && (start = lseek(STDOUT_FILENO, 0, SEEK_CUR)) >= 0)
+        fd = open("/proc/self/fd/1", O_RDWR);
+
+    else
+        return NULL;
+
+    if (fd < 0)
+    {
+        perror(path != NULL ? path : "stdout");
+        return NULL;
+    }
+
+    // the mapping starts at a page boundary, the image wherever stdout was
+    base = start / sysconf(_SC_PAGESIZE) * sysconf(_SC_PAGESIZE);
+    outputMapLength = start - base + length + size;
+
+    if (ftruncate(fd, start + length + size) != 0 || (outputMap = mmap(NULL, outputMapLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, base)) == MAP_FAILED)
+    {
+        perror("Error mapping the image");
+        outputMap = NULL;
+        close(fd);
+        return NULL;
+    }
+
+    close(fd);
+
+    outputMapAfter = (path != NULL) ? -1 : start + (off_t)(length + size);
+    outputMethod = "mmap";
+    outputBytes += length + size;
+
+    memcpy(outputMap + (start - base), header, length);
+
+    outputSeconds += outputClock() - begin;
+
+    return outputMap + (start - base) + length;
+}
+
+// Unmaps the output, the page cache writes back what is left, and leaves stdout after the image
+static inline void outputMapEnd(void)
+{
+    double begin = outputClock();
+
+    munmap(outputMap, outputMapLength);
+
+    if (outputMapAfter >= 0)
+        lseek(STDOUT_FILENO, outputMapAfter, SEEK_SET);
+
+    outputSeconds += outputClock() - begin;
+}
+
+// Throughput of the writer, in MB/s
+static double outputThroughput(void)
+{
+    return outputSeconds > 0 ? outputBytes / outputSeconds / 1e6 : 0;
+}
+
+#endif
@@ -0,0 +1,654 @@
+//
+//  mandelbrot-perturbation.h
+//
+//
+//  Perturbation rendering engine for deep zooms, used instead of iterating
+//  every pixel when MANDELBROT_ENGINE=perturbation.
+//
+//  Past a zoom of about 1e13 the coordinates of neighbouring pixels are no
+//  longer distinct doubles. Instead of iterating every pixel in higher
+//  precision, a single reference orbit Z is iterated in arbitrary precision
+//  (struct big, fixed point, sized from the zoom) at the center of the
+//  view, and every pixel c = C + dc iterates only its difference to it:
+//
+//      d(n+1) = 2 Z(n) d(n) + d(n)^2 + dc,     z(n) = Z(n) + d(n)
+//
+//  which stays small and is accurate in double precision.
+//
+//  - Series approximation: d(n) ~ A(n) dc + B(n) dc^2 + C(n) dc^3 for every
+//    pixel of the rows being rendered, while the cubic term stays
+//    negligible and no pixel can have escaped, so the first iterations are
+//    skipped for all of them at once.
+//  - Glitches: a pixel whose |z| becomes much smaller than |Z| (or that
+//    outlives an escaping reference) loses its precision. Such pixels are
+//    rendered again against a new reference orbit computed at one of them,
+//    up to PERTURB_REFERENCES times; the few left after that are iterated
+//    directly in double precision.
+//
+//  The center is read in full precision from MANDELBROT_CENTER_RE and
+//  MANDELBROT_CENTER_IM (decimal strings, e.g. -0.743643887037158704752191506114774)
+//  and the zoom from MANDELBROT_ZOOM, which can be as large as ~1e290.
+//
+
+#ifndef MANDELBROT_PERTURBATION_H
+#define MANDELBROT_PERTURBATION_H
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <omp.h>
+
+#include "mandelbrot-kernel.h"
+
+// Largest number of 32-bit limbs of a struct big, enough for zooms of ~1e700
+#define BIG_LIMBS 80
+
+// A pixel whose |z|^2 falls below this fraction of |Z|^2 has glitched
+#define PERTURB_GLITCH 1e-6
+
+// The series approximation is used while its cubic term, an estimate of its error, stays below
+// this fraction of the distance between the differences of neighbouring pixels
+#define PERTURB_SERIES_TOLERANCE 1e-6
+
+// Largest number of extra reference orbits computed for the glitched pixels of a call to perturbRender
+#define PERTURB_REFERENCES 16
+
+// The interior pre-check runs while the pixel spacing is this many times the precision of a double coordinate,
+// like PRECISION_MARGIN; deeper, every pixel would be tested at the same few rounded coordinates
+#define PERTURB_INTERIOR_MARGIN 65536.0
+
+
+/*---- Arbitrary precision ---------------------------------------------------------------*/
+
+// Fixed-point number with sign and magnitude: limb[bigLimbs - 1] is the integer part,
+// the lower limbs are the fraction, least significant first
+struct big
+{
+    int neg;
+    uint32_t limb[BIG_LIMBS];
+};
+
+// Number of limbs used by every struct big, chosen from the zoom
+static int bigLimbs = 4;
+
+static void bigZero(struct big *a)
+{
+    memset(a, 0, sizeof(struct big));
+}
+
+// Compares |a| and |b|
+static int bigCompareMagnitude(const struct big *a, const struct big *b)
+{
+    int k;
+
+    for (k = bigLimbs - 1; k >= 0; k--)
+    {
+        if (a->limb[k] != b->limb[k])
+            return a->limb[k] > b->limb[k] ? 1 : -1;
+    }
+
+    return 0;
+}
+
+// r = a + b
+static void bigAdd(struct big *r, const struct big *a, const struct big *b)
+{
+    struct big result;
+    uint64_t carry = 0;
+    int k;
+
+    bigZero(&result);
+
+    if (a->neg == b->neg)
+    {
+        for (k = 0; k < bigLimbs; k++)
+        {
+            uint64_t sum = (uint64_t)a->limb[k] + b->limb[k] + carry;
+
+            result.limb[k] = (uint32_t)sum;
+            carry = sum >> 32;
+        }
+
+        result.neg = a->neg;
+    }
+
+    else
+    {
+        // the smaller magnitude is subtracted from the larger one, which gives the sign
+        const struct big *large = a, *small = b;
+
+        if (bigCompareMagnitude(a, b) < 0)
+        {
+            large = b;
+            small = a;
+        }
+
+        for (k = 0; k < bigLimbs; k++)
+        {
+            int64_t difference = (int64_t)large->limb[k] - small->limb[k] - (int64_t)carry;
+
+            carry = difference < 0;
+            result.limb[k] = (uint32_t)(difference + (carry ? ((int64_t)1 << 32) : 0));
+        }
+
+        result.neg = large->neg;
+    }
+
+    *r = result;
+}
+
+// r = a - b
+static void bigSub(struct big *r, const struct big *a, const struct big *b)
+{
+    struct big negated = *b;
+
+    negated.neg = !negated.neg;
+    bigAdd(r, a, &negated);
+}
+
+// r = a * b, truncated to bigLimbs limbs
+static void bigMul(struct big *r, const struct big *a, const struct big *b)
+{
+    uint32_t product[2 * BIG_LIMBS];
+    int n = bigLimbs, i, j;
+
+    memset(product, 0, sizeof(uint32_t) * 2 * n);
+
+    for (i = 0; i < n; i++)
+    {
+        uint64_t carry = 0;
+
+        if (a->limb[i] == 0)
+            continue;
+
+        for (j = 0; j < n; j++)
+        {
+            uint64_t t = (uint64_t)a->limb[i] * b->limb[j] + product[i + j] + carry;
+
+            product[i + j] = (uint32_t)t;
+            carry = t >> 32;
+        }
+
+        product[i + n] = (uint32_t)carry;
+    }
+
+    // the product has 2n - 2 fraction limbs, the n - 1 most significant ones are kept
+    r->neg = a->neg != b->neg;
+    memcpy(r->limb, product + n - 1, sizeof(uint32_t) * n);
+}
+
+static double bigToDouble(const struct big *a)
+{
+    double value = 0;
+    int k;
+
+    for (k = bigLimbs - 1; k >= 0 && k >= bigLimbs - 4; k--)
+    {
+        value += ldexp((double)a->limb[k], 32 * (k - (bigLimbs - 1)));
+    }
+
+    return a->neg ? -value : value;
+}
+
+// r = d, exactly, for |d| < 2^32
+static void bigFromDouble(struct big *r, double d)
+{
+    int k;
+
+    bigZero(r);
+    r->neg = d < 0;
+    d = fabs(d);
+
+    for (k = bigLimbs - 1; k >= 0 && d > 0; k--)
+    {
+        double limb = floor(d);
+
+        r->limb[k] = (uint32_t)limb;
+        d = ldexp(d - limb, 32);
+    }
+}
+
+// Reads a decimal number such as -0.7436438870371587047521915061 or 1.25e-3 into r
+// Returns 0, or -1 if text is not a number
+static int bigParse(struct big *r, const char *text)
+{
+    char digits[4096];
+    int count = 0, point = -1, exponent = 0, neg = 0, k;
+
+    while (isspace((unsigned char)*text))
+        text++;
+
+    if (*text == '-' || *text == '+')
+        neg = (*text++ == '-');
+
+    for (; *text != '\0' && count < (int)sizeof(digits); text++)
+    {
+        if (isdigit((unsigned char)*text))
+            digits[count++] = *text - '0';
+        else if (*text == '.' && point < 0)
+            point = count;
+        else
+            break;
+    }
+
+    if (count == 0)
+        return -1;
+
+    if (*text == 'e' || *text == 'E')
+        exponent = atoi(text + 1);
+
+    // position of the decimal point among the digits
+    point = (point < 0 ? count : point) + exponent;
+
+    bigZero(r);
+
+    // fraction digits, from the last one: x = (x + digit) / 10
+    for (k = count - 1; k >= 0 && k >= point; k--)
+    {
+        uint64_t remainder = 0;
+        int limb;
+
+        r->limb[bigLimbs - 1] = digits[k];
+
+        for (limb = bigLimbs - 1; limb >= 0; limb--)
+        {
+            uint64_t current = (remainder << 32) | r->limb[limb];
+
+            r->limb[limb] = (uint32_t)(current / 10);
+            remainder = current % 10;
+        }
+    }
+
+    // leading zeros of the fraction when the point lies before the digits
+    for (k = point; k < 0; k++)
+    {
+        uint64_t remainder = 0;
+        int limb;
+
+        for (limb = bigLimbs - 1; limb >= 0; limb--)
+        {
+            uint64_t current = (remainder << 32) | r->limb[limb];
+
+            r->limb[limb] = (uint32_t)(current / 10);
+            remainder = current % 10;
+        }
+    }
+
+    // integer digits
+    uint32_t integer = 0;
+
+    for (k = 0; k < point && k < count; k++)
+        integer = integer * 10 + digits[k];
+
+    for (; k < point; k++)
+        integer *= 10;
+
+    r->limb[bigLimbs - 1] = integer;
+    r->neg = neg;
+
+    return 0;
+}
+
+
+/*---- Reference orbits ---------------------------------------------------------------*/
+
+// Orbit Z(0) = 0 ... Z(length) of a reference point, in double precision, and |Z(n)|^2
+// length is maxIterations, or the first iteration in which the reference escaped
+struct perturbReference
+{
+    double *re, *im, *norm;
+    int length;
+};
+
+// Center of the view in full precision
+static struct big perturbCenterRe, perturbCenterIm;
+
+// Reference orbit of the center of the view
+static struct perturbReference perturbMain;
+
+// Reference orbits computed, pixels rendered again because they glitched,
+// and iterations skipped by the series approximation, by this process
+static long long perturbReferences = 0, perturbGlitched = 0, perturbSkipped = 0;
+
+// Seconds spent computing the reference orbit of the center
+static double perturbSeconds = 0;
+
+// Whether MANDELBROT_ENGINE selects this engine instead of the per-pixel loop
+static int perturbSelected(void)
+{
+    const char *engine = getenv("MANDELBROT_ENGINE");
+
+    return engine != NULL && strcmp(engine, "perturbation") == 0;
+}
+
+// Iterates the reference orbit of the point (re, im) in full precision
+static void perturbOrbit(struct perturbReference *ref, const struct big *re, const struct big *im, int maxIterations)
+{
+    struct big zr, zi, zr2, zi2, zri;
+    int n;
+
+    ref->re = malloc(sizeof(double) * (maxIterations + 1));
+    ref->im = malloc(sizeof(double) * (maxIterations + 1));
+    ref->norm = malloc(sizeof(double) * (maxIterations + 1));
+
+    bigZero(&zr);
+    bigZero(&zi);
+
+    ref->re[0] = ref->im[0] = ref->norm[0] = 0;
+
+    for (n = 1; n <= maxIterations; n++)
+    {
+        // Z = Z^2 + C
+        bigMul(&zr2, &zr, &zr);
+        bigMul(&zi2, &zi, &zi);
+        bigMul(&zri, &zr, &zi);
+
+        bigSub(&zr, &zr2, &zi2);
+        bigAdd(&zr, &zr, re);
+        bigAdd(&zi, &zri, &zri);
+        bigAdd(&zi, &zi, im);
+
+        ref->re[n] = bigToDouble(&zr);
+        ref->im[n] = bigToDouble(&zi);
+        ref->norm[n] = ref->re[n] * ref->re[n] + ref->im[n] * ref->im[n];
+
+        if (ref->norm[n] > 4)
+            break;
+    }
+
+    ref->length = (n > maxIterations) ? maxIterations : n;
+
+    #pragma omp atomic
+    perturbReferences++;
+}
+
+static void perturbFree(struct perturbReference *ref)
+{
+    free(ref->re);
+    free(ref->im);
+    free(ref->norm);
+}
+
+// Reads the center of the view in full precision and computes its reference orbit
+// view holds the zoom and the center already read by viewInit
+static void perturbInit(const struct view *view, int maxIterations)
+{
+    const char *re = getenv("MANDELBROT_CENTER_RE");
+    const char *im = getenv("MANDELBROT_CENTER_IM");
+    double begin = omp_get_wtime();
+
+    if (!perturbSelected())
+        return;
+
+    // the fraction holds the pixel spacing and 64 more bits
+    double bits = log2(view->zoom * (view->w > view->h ? view->w : view->h)) + 64;
+
+    bigLimbs = 1 + (int)ceil((bits > 64 ? bits : 64) / 32);
+
+    if (bigLimbs > BIG_LIMBS)
+    {
+        fprintf(stderr, "Zoom %g is too deep for the perturbation engine, the precision is capped at %d bits\n", view->zoom, 32 * (BIG_LIMBS - 1));
+        bigLimbs = BIG_LIMBS;
+    }
+
+    if (re == NULL || bigParse(&perturbCenterRe, re) != 0)
+        bigFromDouble(&perturbCenterRe, view->moveX);
+
+    if (im == NULL || bigParse(&perturbCenterIm, im) != 0)
+        bigFromDouble(&perturbCenterIm, view->moveY);
+
+    perturbOrbit(&perturbMain, &perturbCenterRe, &perturbCenterIm, maxIterations);
+
+    perturbSeconds = omp_get_wtime() - begin;
+}
+
+
+/*---- Pixels ---------------------------------------------------------------*/
+
+// Distance from the center of the view to the pixels in column x / row y
+static inline double perturbOffsetRe(const struct view *view, int x)
+{
+    return 1.5 * (x - view->w / 2) / (0.5 * view->zoom * view->w);
+}
+
+static inline double perturbOffsetIm(const struct view *view, int y)
+{
+    return (y - view->h / 2) / (0.5 * view->zoom * view->h);
+}
+
+// Iterates the pixel at distance (dcr, dci) from the reference, from iteration start and difference (dr, di)
+// Returns the escape iteration and final |z|^2 like escapePoint, or -1 if the pixel glitched,
+// with the ratio |z|^2 / |Z|^2 in *glitch (the smaller, the closer the pixel is to the center of its glitch)
+static int perturbPoint(const struct perturbReference *ref, double dcr, double dci, int start, double dr, double di, int maxIterations, double *norm, double *glitch)
+{
+    double n = 0;
+    int i;
+
+    for (i = start; i < maxIterations; i++)
+    {
+        // the reference escaped before this pixel
+        if (i + 1 > ref->length)
+        {
+            *glitch = 1;
+            return -1;
+        }
+
+        double zr = ref->re[i], zi = ref->im[i];
+
+        // d = 2 Z d + d^2 + dc
+        double ndr = 2 * (zr * dr - zi * di) + dr * dr - di * di + dcr;
+        double ndi = 2 * (zr * di + zi * dr) + 2 * dr * di + dci;
+
+        dr = ndr;
+        di = ndi;
+
+        double pr = ref->re[i + 1] + dr, pi = ref->im[i + 1] + di;
+
+        n = pr * pr + pi * pi;
+
+        if (n > 4)
+            break;
+
+        if (n < PERTURB_GLITCH * ref->norm[i + 1])
+        {
+            *glitch = n / ref->norm[i + 1];
+            return -1;
+        }
+    }
+
+    *norm = n;
+
+    return i;
+}
+
+// Series approximation of the differences of every pixel within distance radius of the reference,
+// scaled so that d(skip) ~ A u + B u^2 + C u^3 with u = dc / radius, for pixels spacing apart
+// Returns the number of iterations skipped, skip, and A, B, C as {re, im} pairs in coef
+static int perturbSeries(const struct perturbReference *ref, double radius, double spacing, int maxIterations, double coef[6])
+{
+    double ar = 0, ai = 0, br = 0, bi = 0, cr = 0, ci = 0;
+    int n;
+
+    for (n = 0; n + 1 < ref->length && n + 1 < maxIterations; n++)
+    {
+        double zr = 2 * ref->re[n], zi = 2 * ref->im[n];
+
+        // A = 2 Z A + radius, B = 2 Z B + A^2, C = 2 Z C + 2 A B
+        double nar = zr * ar - zi * ai + radius, nai = zr * ai + zi * ar;
+        double nbr = zr * br - zi * bi + ar * ar - ai * ai, nbi = zr * bi + zi * br + 2 * ar * ai;
+        double ncr = zr * cr - zi * ci + 2 * (ar * br - ai * bi), nci = zr * ci + zi * cr + 2 * (ar * bi + ai * br);
+
+        double a = hypot(nar, nai), b = hypot(nbr, nbi), c = hypot(ncr, nci);
+
+        // the cubic term is no longer negligible next to the distance between neighbouring pixels, ~ A spacing / radius
+        if (c > PERTURB_SERIES_TOLERANCE * a * spacing / radius)
+            break;
+
+        // some pixel could have escaped by now
+        if (sqrt(ref->norm[n + 1]) + a + b + c > 2)
+            break;
+
+        ar = nar; ai = nai;
+        br = nbr; bi = nbi;
+        cr = ncr; ci = nci;
+    }
+
+    coef[0] = ar; coef[1] = ai;
+    coef[2] = br; coef[3] = bi;
+    coef[4] = cr; coef[5] = ci;
+
+    return n;
+}
+
+// Renders rows y0..y1-1 of the image into iterations and norms, which hold (y1 - y0) * view->w pixels
+// Opens its own parallel region; called from inside one, the rows are rendered by the calling thread only
+static void perturbRender(const struct view *view, int y0, int y1, int maxIterations, int *iterations, double *norms)
+{
+    int w = view->w, count = (y1 - y0) * w;
+    int x, y, g;
+
+    // pixels that glitched, and their |z|^2 / |Z|^2 when they did
+    int *glitched = malloc(sizeof(int) * (count > 0 ? count : 1));
+    double *ratios = malloc(sizeof(double) * (count > 0 ? count : 1));
+    int glitchCount = 0;
+
+    // largest distance from the reference to a pixel of the rows
+    double farRe = fmax(fabs(perturbOffsetRe(view, 0)), fabs(perturbOffsetRe(view, w - 1)));
+    double farIm = fmax(fabs(perturbOffsetIm(view, y0)), fabs(perturbOffsetIm(view, y1 - 1)));
+    double radius = hypot(farRe, farIm);
+
+    double coef[6] = {0, 0, 0, 0, 0, 0};
+    int skip = (radius > 0) ? perturbSeries(&perturbMain, radius, perturbOffsetRe(view, 1) - perturbOffsetRe(view, 0), maxIterations, coef) : 0;
+
+    // pixels painted by the interior pre-check
+    long long interior = 0;
+
+    // the pre-check tests the double coordinates of the pixel, which are only distinct at shallow zooms
+    double spacing = fmin(1.5 / (0.5 * view->zoom * view->w), 1 / (0.5 * view->zoom * view->h));
+    double scale = fmax(2, fmax(fabs(view->moveX), fabs(view->moveY)));
+    int checkInterior = escapeCheckInterior && spacing > scale * ldexp(1, -52) * PERTURB_INTERIOR_MARGIN;
+
+    #pragma omp parallel for schedule(dynamic) private(x) reduction(+:interior) if (!omp_in_parallel())
+    for (y = y0; y < y1; y++)
+    {
+        double dci = perturbOffsetIm(view, y);
+
+        for (x = 0; x < w; x++)
+        {
+            int pos = (y - y0) * w + x;
+            double dcr = perturbOffsetRe(view, x), dr = 0, di = 0, glitch;
+
+            // the interior pre-check of the kernel, at the double precision coordinates of the pixel
+            if (checkInterior && escapeInterior(pixelRe(view, x), pixelIm(view, y)))
+            {
+                iterations[pos] = maxIterations;
+                norms[pos] = 0;
+
+                interior++;
+                continue;
+            }
+
+            // starting difference from the series
+            if (skip > 0)
+            {
+                double ur = dcr / radius, ui = dci / radius;
+                double u2r = ur * ur - ui * ui, u2i = 2 * ur * ui;
+                double u3r = u2r * ur - u2i * ui, u3i = u2r * ui + u2i * ur;
+
+                dr = coef[0] * ur - coef[1] * ui + coef[2] * u2r - coef[3] * u2i + coef[4] * u3r - coef[5] * u3i;
+                di = coef[0] * ui + coef[1] * ur + coef[2] * u2i + coef[3] * u2r + coef[4] * u3i + coef[5] * u3r;
+            }
+
+            iterations[pos] = perturbPoint(&perturbMain, dcr, dci, skip, dr, di, maxIterations, &norms[pos], &glitch);
+
+            if (iterations[pos] < 0)
+            {
+                int slot;
+
+                #pragma omp atomic capture
+                slot = glitchCount++;
+
+                glitched[slot] = pos;
+                ratios[slot] = glitch;
+            }
+        }
+    }
+
+    #pragma omp atomic
+    escapeTotals.interior += interior;
+
+    #pragma omp atomic
+    perturbSkipped += (long long)skip * (count - interior - glitchCount);
+
+    #pragma omp atomic
+    perturbGlitched += glitchCount;
+
+    // the glitched pixels are rendered again against a reference computed at the one deepest in its glitch
+    int round;
+
+    for (round = 0; round < PERTURB_REFERENCES && glitchCount > 0; round++)
+    {
+        struct perturbReference ref;
+        struct big offset, re, im;
+        int best = 0, remaining = 0;
+
+        for (g = 1; g < glitchCount; g++)
+        {
+            if (ratios[g] < ratios[best])
+                best = g;
+        }
+
+        double refRe = perturbOffsetRe(view, glitched[best] % w);
+        double refIm = perturbOffsetIm(view, y0 + glitched[best] / w);
+
+        bigFromDouble(&offset, refRe);
+        bigAdd(&re, &perturbCenterRe, &offset);
+        bigFromDouble(&offset, refIm);
+        bigAdd(&im, &perturbCenterIm, &offset);
+
+        perturbOrbit(&ref, &re, &im, maxIterations);
+
+        #pragma omp parallel for schedule(dynamic, 64) if (!omp_in_parallel())
+        for (g = 0; g < glitchCount; g++)
+        {
+            int pos = glitched[g];
+            double dcr = perturbOffsetRe(view, pos % w) - refRe, dci = perturbOffsetIm(view, y0 + pos / w) - refIm;
+
+            iterations[pos] = perturbPoint(&ref, dcr, dci, 0, 0, 0, maxIterations, &norms[pos], &ratios[g]);
+        }
+
+        perturbFree(&ref);
+
+        // keeps the pixels that glitched again
+        for (g = 0; g < glitchCount; g++)
+        {
+            if (iterations[glitched[g]] < 0)
+            {
+                glitched[remaining] = glitched[g];
+                ratios[remaining] = ratios[g];
+                remaining++;
+            }
+        }
+
+        glitchCount = remaining;
+    }
+
+    // the pixels left are iterated directly, in double precision
+    struct escapeStats stats = {0, 0, 0, 0};
+
+    for (g = 0; g < glitchCount; g++)
+    {
+        int pos = glitched[g];
+
+        iterations[pos] = escapePoint(pixelRe(view, pos % w), pixelIm(view, y0 + pos / w), maxIterations, &norms[pos], &stats);
+    }
+
+    #pragma omp atomic
+    escapeTotals.cycles += stats.cycles;
+
+    free(glitched);
+    free(ratios);
+}
+
+#endif
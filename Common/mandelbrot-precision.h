@@ -0,0 +1,914 @@
+//
+//  mandelbrot-precision.h
+//
+//
+//  Kernels in other precisions than double: single precision for shallow
+//  zooms and extended precision for moderately deep ones.
+//
+//  At the standard view, floats tell the pixels apart as well as doubles
+//  and a vector holds twice as many of them: the float kernels iterate 8
+//  pixels per AVX2 vector and 16 per AVX-512 vector. A float orbit drifts
+//  away from the double one much sooner, though, and the pixels that
+//  change their escape iteration, or even cross maxIterations, lie along
+//  the boundary of the set, too thin for a sparse grid to find them.
+//  Before the float kernel is used, PRECISION_FLOAT_ROWS whole rows of
+//  the view, the row through its center among them, are iterated in both
+//  precisions. The rows cross the boundary wherever it runs across the
+//  view, and the view stays in double if a sampled pixel crosses
+//  maxIterations in one precision only, or if more than
+//  PRECISION_FLOAT_MISMATCHES of them end in another iteration.
+//
+//  With doubles, neighbouring pixels stop being distinct points once the
+//  pixel spacing approaches the precision of the coordinates, and well
+//  before that the rounding errors of each iteration change the escape
+//  counts. Instead of the perturbation engine, which pays off at much
+//  deeper zooms, the pixels can be iterated in a wider type:
+//
+//  - double-double: a pair of doubles hi + lo, ~106 bits of mantissa,
+//    with error-free transformations built on FMA. Vectorised with AVX2,
+//    4 pixels per vector, and a scalar kernel for the other nodes.
+//  - quad: __float128, 113 bits, emulated in software by the compiler.
+//
+//  precisionInit() picks the cheapest of float, double, double-double and
+//  quad whose precision stays PRECISION_MARGIN times below the pixel
+//  spacing (PRECISION_FLOAT_MARGIN for float, which the sample backs up),
+//  from the zoom and the image size. MANDELBROT_PRECISION forces one
+//  (float, double, double-double or quad); a forced float view that fails
+//  the sample is still iterated in double.
+//
+//  The center of the view is read from MANDELBROT_CENTER_RE and
+//  MANDELBROT_CENTER_IM in quad precision, so its digits past the 17th
+//  are not lost. The offset of each pixel from the center is small and
+//  is kept in double.
+//
+//  Only the per-pixel engine uses these kernels, through precisionRow();
+//  it falls back to escapeRow() when the precision is double.
+//
+
+#ifndef MANDELBROT_PRECISION_H
+#define MANDELBROT_PRECISION_H
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+
+#include "mandelbrot-kernel.h"
+
+// Precision of the coordinates, in units of the pixel spacing, below which a precision is used
+#define PRECISION_MARGIN 65536.0
+
+// The same for float, whose rounding errors are checked on a sample of the view
+#define PRECISION_FLOAT_MARGIN 256.0
+
+// Rows of the view iterated in float and double before the float kernel is used, evenly spaced from the top
+#define PRECISION_FLOAT_ROWS 16
+
+// Sampled pixels allowed to end in another iteration in float, provided none of them crosses maxIterations
+#define PRECISION_FLOAT_MISMATCHES 1
+
+// Precisions of the kernels, from the cheapest
+#define PRECISION_FLOAT 0
+#define PRECISION_DOUBLE 1
+#define PRECISION_DD 2
+#define PRECISION_QUAD 3
+
+// Precision selected by precisionInit, and its name reported with the execution time
+static int precisionLevel = PRECISION_DOUBLE;
+static const char *precisionName = "double";
+
+// Distance between neighbouring pixels of the view
+static double precisionSpacing = 0;
+
+// Sampled pixels whose float escape iteration differed from the double one, -1 when no sample was taken,
+// how many of them crossed maxIterations, and how many pixels were sampled
+static int precisionMismatches = -1, precisionCrossed = 0, precisionSamples = 0;
+
+
+/*---- Float ---------------------------------------------------------------*/
+
+// Iterates a single point in float, like escapePoint
+static int floatPoint(float pr, float pi, int maxIterations, float epsilon, double *norm, struct escapeStats *stats)
+{
+    float re = 0, im = 0, re2 = 0, im2 = 0;
+    float savedRe = 0, savedIm = 0;
+    long long save = 1;
+    int i;
+
+    for (i = 0; i < maxIterations; i++)
+    {
+        im = 2 * re * im + pi;
+        re = re2 - im2 + pr;
+        re2 = re * re;
+        im2 = im * im;
+
+        //if the point is outside the circle with radius 2: stop
+        if ((re2 + im2) > 4)
+            break;
+
+        // the orbit is back where it was: it repeats forever
+        if (fabsf(re - savedRe) + fabsf(im - savedIm) < epsilon)
+        {
+            stats->cycles++;
+            stats->slots += i + 1;
+            stats->active += i + 1;
+
+            *norm = re2 + im2;
+            return maxIterations;
+        }
+
+        if (i + 1 == save)
+        {
+            savedRe = re;
+            savedIm = im;
+            save *= 2;
+        }
+    }
+
+    stats->slots += escapeCost(i, maxIterations);
+    stats->active += escapeCost(i, maxIterations);
+
+    *norm = re2 + im2;
+    return i;
+}
+
+// Distance under which a float orbit is taken to have returned to the saved value:
+// a few hundred ulps of float, as ESCAPE_CYCLE_EPSILON is for double
+static inline float floatCycleEpsilon(void)
+{
+    return (float)ldexp(escapeCycleEpsilon, 29);
+}
+
+// Scalar float kernel, one pixel at a time, with the signature of the double kernels
+static void floatScalar(const double *cr, const double *ci, int n, int maxIterations, int *iterations, double *norms, struct escapeStats *stats)
+{
+    float epsilon = floatCycleEpsilon();
+    int k;
+
+    for (k = 0; k < n; k++)
+    {
+        iterations[k] = floatPoint((float)cr[k], (float)ci[k], maxIterations, epsilon, &norms[k], stats);
+    }
+}
+
+#ifdef ESCAPE_X86
+
+// AVX2 float kernel, 8 pixels per vector, in the same way as escapeAVX2
+__attribute__((target("avx2,fma")))
+static void floatAVX2(const double *cr, const double *ci, int n, int maxIterations, int *iterations, double *norms, struct escapeStats *stats)
+{
+    const __m256 four = _mm256_set1_ps(4.0f);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 epsilon = _mm256_set1_ps(floatCycleEpsilon());
+    int k, i, j;
+
+    for (k = 0; k + 8 <= n; k += 8)
+    {
+        __m256 pr = _mm256_set_m128(_mm256_cvtpd_ps(_mm256_loadu_pd(cr + k + 4)), _mm256_cvtpd_ps(_mm256_loadu_pd(cr + k)));
+        __m256 pi = _mm256_set_m128(_mm256_cvtpd_ps(_mm256_loadu_pd(ci + k + 4)), _mm256_cvtpd_ps(_mm256_loadu_pd(ci + k)));
+        __m256 re = _mm256_setzero_ps(), im = re, re2 = re, im2 = re;
+        __m256 savedRe = re, savedIm = re;
+        __m256 norm = re, count = re, cycled = re;
+        __m256 active = _mm256_cmp_ps(re, re, _CMP_EQ_OQ);
+        long long save = 1;
+
+        for (i = 0; i < maxIterations; i++)
+        {
+            im = _mm256_fmadd_ps(_mm256_add_ps(re, re), im, pi);
+            re = _mm256_add_ps(_mm256_sub_ps(re2, im2), pr);
+            re2 = _mm256_mul_ps(re, re);
+            im2 = _mm256_mul_ps(im, im);
+
+            __m256 mag = _mm256_add_ps(re2, im2);
+            __m256 escaped = _mm256_and_ps(_mm256_cmp_ps(mag, four, _CMP_GT_OQ), active);
+
+            // distance to the saved z, for the lanes that did not escape
+            __m256 distance = _mm256_add_ps(_mm256_andnot_ps(sign, _mm256_sub_ps(re, savedRe)),
+                                            _mm256_andnot_ps(sign, _mm256_sub_ps(im, savedIm)));
+            __m256 periodic = _mm256_andnot_ps(escaped, _mm256_and_ps(_mm256_cmp_ps(distance, epsilon, _CMP_LT_OQ), active));
+
+            norm = _mm256_blendv_ps(norm, mag, _mm256_or_ps(escaped, periodic));
+            cycled = _mm256_or_ps(cycled, periodic);
+            active = _mm256_andnot_ps(_mm256_or_ps(escaped, periodic), active);
+
+            if (_mm256_movemask_ps(active) == 0)
+                break;
+
+            count = _mm256_add_ps(count, _mm256_and_ps(active, one));
+
+            if (i + 1 == save)
+            {
+                savedRe = re;
+                savedIm = im;
+                save *= 2;
+            }
+        }
+
+        // lanes that never escaped keep the last |z|^2
+        norm = _mm256_blendv_ps(norm, _mm256_add_ps(re2, im2), active);
+
+        _mm256_storeu_si256((__m256i *)(iterations + k), _mm256_cvtps_epi32(count));
+        _mm256_storeu_pd(norms + k, _mm256_cvtps_pd(_mm256_castps256_ps128(norm)));
+        _mm256_storeu_pd(norms + k + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(norm, 1)));
+
+        // the vector ran until its last lane finished
+        stats->slots += 8 * escapeCost(i, maxIterations);
+
+        for (j = 0; j < 8; j++)
+        {
+            stats->active += escapeCost(iterations[k + j], maxIterations);
+
+            // periodic lanes belong to the set
+            if ((_mm256_movemask_ps(cycled) >> j) & 1)
+            {
+                iterations[k + j] = maxIterations;
+                stats->cycles++;
+            }
+        }
+    }
+
+    // remaining pixels of the run
+    floatScalar(cr + k, ci + k, n - k, maxIterations, iterations + k, norms + k, stats);
+}
+
+// AVX-512 float kernel, 16 pixels per vector, in the same way as escapeAVX512
+__attribute__((target("avx512f")))
+static void floatAVX512(const double *cr, const double *ci, int n, int maxIterations, int *iterations, double *norms, struct escapeStats *stats)
+{
+    const __m512 four = _mm512_set1_ps(4.0f);
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512 epsilon = _mm512_set1_ps(floatCycleEpsilon());
+    int counts[16];
+    int k, i, j;
+
+    for (k = 0; k < n; k += 16)
+    {
+        __mmask16 lanes = (n - k >= 16) ? 0xFFFF : (__mmask16)((1u << (n - k)) - 1);
+        __mmask8 low = (__mmask8)lanes, high = (__mmask8)(lanes >> 8);
+
+        // the doubles are converted 8 at a time, the upper 8 are inserted above the lower ones
+        __m512 pr = _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(_mm512_cvtpd_ps(_mm512_maskz_loadu_pd(low, cr + k)))),
+                                                        _mm256_castps_pd(_mm512_cvtpd_ps(_mm512_maskz_loadu_pd(high, cr + k + 8))), 1));
+        __m512 pi = _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(_mm512_cvtpd_ps(_mm512_maskz_loadu_pd(low, ci + k)))),
+                                                        _mm256_castps_pd(_mm512_cvtpd_ps(_mm512_maskz_loadu_pd(high, ci + k + 8))), 1));
+        __m512 re = _mm512_setzero_ps(), im = re, re2 = re, im2 = re;
+        __m512 savedRe = re, savedIm = re;
+        __m512 norm = re, count = re;
+        __mmask16 active = lanes, cycled = 0;
+        long long save = 1;
+
+        for (i = 0; i < maxIterations; i++)
+        {
+            im = _mm512_fmadd_ps(_mm512_add_ps(re, re), im, pi);
+            re = _mm512_add_ps(_mm512_sub_ps(re2, im2), pr);
+            re2 = _mm512_mul_ps(re, re);
+            im2 = _mm512_mul_ps(im, im);
+
+            __m512 mag = _mm512_add_ps(re2, im2);
+            __mmask16 escaped = _mm512_mask_cmp_ps_mask(active, mag, four, _CMP_GT_OQ);
+
+            // distance to the saved z, for the lanes that did not escape
+            __m512 distance = _mm512_add_ps(_mm512_abs_ps(_mm512_sub_ps(re, savedRe)),
+                                            _mm512_abs_ps(_mm512_sub_ps(im, savedIm)));
+            __mmask16 periodic = _mm512_mask_cmp_ps_mask(active & ~escaped, distance, epsilon, _CMP_LT_OQ);
+
+            norm = _mm512_mask_mov_ps(norm, escaped | periodic, mag);
+            cycled |= periodic;
+            active &= ~(escaped | periodic);
+
+            if (active == 0)
+                break;
+
+            count = _mm512_mask_add_ps(count, active, count, one);
+
+            if (i + 1 == save)
+            {
+                savedRe = re;
+                savedIm = im;
+                save *= 2;
+            }
+        }
+
+        // lanes that never escaped keep the last |z|^2
+        norm = _mm512_mask_add_ps(norm, active, re2, im2);
+
+        _mm512_storeu_si512(counts, _mm512_cvtps_epi32(count));
+        _mm512_mask_storeu_pd(norms + k, low, _mm512_cvtps_pd(_mm512_castps512_ps256(norm)));
+        _mm512_mask_storeu_pd(norms + k + 8, high, _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(norm), 1))));
+
+        // the vector ran until its last lane finished
+        stats->slots += 16 * escapeCost(i, maxIterations);
+
+        for (j = 0; j < 16 && k + j < n; j++)
+        {
+            stats->active += escapeCost(counts[j], maxIterations);
+
+            // periodic lanes belong to the set
+            if ((cycled >> j) & 1)
+            {
+                counts[j] = maxIterations;
+                stats->cycles++;
+            }
+        }
+
+        memcpy(iterations + k, counts, sizeof(int) * ((n - k < 16) ? n - k : 16));
+    }
+}
+
+#endif
+
+// Float kernel selected by precisionInit
+static escapeKernel floatRun = floatScalar;
+
+// Iterates PRECISION_FLOAT_ROWS rows of the view in float and in double, skipping the pixels the pre-check paints
+// Returns how many pixels end in different iterations; crossed counts those inside the set in one precision only
+static int floatSample(const struct view *view, int maxIterations, int *crossed, int *samples)
+{
+    int rows = (view->h < PRECISION_FLOAT_ROWS) ? view->h : PRECISION_FLOAT_ROWS;
+    int mismatches = 0, across = 0, sampled = 0, r;
+
+    #pragma omp parallel for schedule(dynamic) reduction(+:mismatches, across, sampled)
+    for (r = 0; r < rows; r++)
+    {
+        double *cr = malloc(sizeof(double) * view->w), *ci = malloc(sizeof(double) * view->w);
+        double *floatNorms = malloc(sizeof(double) * view->w), *doubleNorms = malloc(sizeof(double) * view->w);
+        int *floatIterations = malloc(sizeof(int) * view->w), *doubleIterations = malloc(sizeof(int) * view->w);
+        struct escapeStats stats = {0, 0, 0, 0};
+
+        // with an even number of rows, row rows / 2 runs through the center of the view
+        int y = (int)((long long)r * view->h / rows), n = 0, x, k;
+
+        for (x = 0; x < view->w; x++)
+        {
+            cr[n] = pixelRe(view, x);
+            ci[n] = pixelIm(view, y);
+
+            if (!escapeCheckInterior || !escapeInterior(cr[n], ci[n]))
+                n++;
+        }
+
+        floatRun(cr, ci, n, maxIterations, floatIterations, floatNorms, &stats);
+        escapeRun(cr, ci, n, maxIterations, doubleIterations, doubleNorms, &stats);
+
+        for (k = 0; k < n; k++)
+        {
+            if (floatIterations[k] != doubleIterations[k])
+                mismatches++;
+
+            if ((floatIterations[k] == maxIterations) != (doubleIterations[k] == maxIterations))
+                across++;
+        }
+
+        sampled += n;
+
+        free(cr);
+        free(ci);
+        free(floatNorms);
+        free(doubleNorms);
+        free(floatIterations);
+        free(doubleIterations);
+    }
+
+    *crossed = across;
+    *samples = sampled;
+
+    return mismatches;
+}
+
+
+/*---- Double-double ---------------------------------------------------------------*/
+
+// hi + lo, with |lo| at most half an ulp of hi
+struct dd
+{
+    double hi, lo;
+};
+
+// Center of the view in double-double
+static struct dd precisionCenterRe, precisionCenterIm;
+
+// s + e = a + b exactly
+static inline struct dd ddTwoSum(double a, double b)
+{
+    struct dd r;
+    double bb;
+
+    r.hi = a + b;
+    bb = r.hi - a;
+    r.lo = (a - (r.hi - bb)) + (b - bb);
+
+    return r;
+}
+
+// s + e = a + b exactly, when |a| >= |b|
+static inline struct dd ddQuickTwoSum(double a, double b)
+{
+    struct dd r;
+
+    r.hi = a + b;
+    r.lo = b - (r.hi - a);
+
+    return r;
+}
+
+static inline struct dd ddAdd(struct dd a, struct dd b)
+{
+    struct dd s = ddTwoSum(a.hi, b.hi);
+    struct dd t = ddTwoSum(a.lo, b.lo);
+
+    s = ddQuickTwoSum(s.hi, s.lo + t.hi);
+
+    return ddQuickTwoSum(s.hi, s.lo + t.lo);
+}
+
+static inline struct dd ddMul(struct dd a, struct dd b)
+{
+    double p = a.hi * b.hi;
+    double e = fma(a.hi, b.hi, -p);
+
+    return ddQuickTwoSum(p, e + (a.hi * b.lo + a.lo * b.hi));
+}
+
+static inline struct dd ddNeg(struct dd a)
+{
+    a.hi = -a.hi;
+    a.lo = -a.lo;
+
+    return a;
+}
+
+// Iterates a single point in double-double, like escapePoint
+static int ddPoint(struct dd cr, struct dd ci, int maxIterations, double epsilon, double *norm, struct escapeStats *stats)
+{
+    struct dd re = {0, 0}, im = {0, 0}, re2 = {0, 0}, im2 = {0, 0};
+    struct dd savedRe = {0, 0}, savedIm = {0, 0};
+    long long save = 1;
+    int i;
+
+    for (i = 0; i < maxIterations; i++)
+    {
+        struct dd twoRe = {2 * re.hi, 2 * re.lo};
+
+        im = ddAdd(ddMul(twoRe, im), ci);
+        re = ddAdd(ddAdd(re2, ddNeg(im2)), cr);
+        re2 = ddMul(re, re);
+        im2 = ddMul(im, im);
+
+        //if the point is outside the circle with radius 2: stop
+        if ((re2.hi + im2.hi) > 4)
+            break;
+
+        // the orbit is back where it was: it repeats forever
+        if (fabs((re.hi - savedRe.hi) + (re.lo - savedRe.lo)) + fabs((im.hi - savedIm.hi) + (im.lo - savedIm.lo)) < epsilon)
+        {
+            stats->cycles++;
+            stats->slots += i + 1;
+            stats->active += i + 1;
+
+            *norm = re2.hi + im2.hi;
+            return maxIterations;
+        }
+
+        if (i + 1 == save)
+        {
+            savedRe = re;
+            savedIm = im;
+            save *= 2;
+        }
+    }
+
+    stats->slots += escapeCost(i, maxIterations);
+    stats->active += escapeCost(i, maxIterations);
+
+    *norm = re2.hi + im2.hi;
+    return i;
+}
+
+// Scalar double-double kernel, one pixel at a time
+static void ddScalar(const struct escapeWork *work, int n, int maxIterations, double epsilon, int *iterations, double *norms, struct escapeStats *stats)
+{
+    int k;
+
+    for (k = 0; k < n; k++)
+    {
+        struct dd cr = {work->cr[k], work->crLo[k]}, ci = {work->ci[k], work->ciLo[k]};
+
+        iterations[k] = ddPoint(cr, ci, maxIterations, epsilon, &norms[k], stats);
+    }
+}
+
+#ifdef ESCAPE_X86
+
+// Vector forms of ddTwoSum, ddQuickTwoSum, ddAdd and ddMul, on 4 lanes
+__attribute__((target("avx2,fma")))
+static inline void ddTwoSumAVX2(__m256d a, __m256d b, __m256d *s, __m256d *e)
+{
+    __m256d bb;
+
+    *s = _mm256_add_pd(a, b);
+    bb = _mm256_sub_pd(*s, a);
+    *e = _mm256_add_pd(_mm256_sub_pd(a, _mm256_sub_pd(*s, bb)), _mm256_sub_pd(b, bb));
+}
+
+__attribute__((target("avx2,fma")))
+static inline void ddQuickTwoSumAVX2(__m256d a, __m256d b, __m256d *s, __m256d *e)
+{
+    *s = _mm256_add_pd(a, b);
+    *e = _mm256_sub_pd(b, _mm256_sub_pd(*s, a));
+}
+
+__attribute__((target("avx2,fma")))
+static inline void ddAddAVX2(__m256d aHi, __m256d aLo, __m256d bHi, __m256d bLo, __m256d *hi, __m256d *lo)
+{
+    __m256d sHi, sLo, tHi, tLo;
+
+    ddTwoSumAVX2(aHi, bHi, &sHi, &sLo);
+    ddTwoSumAVX2(aLo, bLo, &tHi, &tLo);
+    ddQuickTwoSumAVX2(sHi, _mm256_add_pd(sLo, tHi), &sHi, &sLo);
+    ddQuickTwoSumAVX2(sHi, _mm256_add_pd(sLo, tLo), hi, lo);
+}
+
+__attribute__((target("avx2,fma")))
+static inline void ddMulAVX2(__m256d aHi, __m256d aLo, __m256d bHi, __m256d bLo, __m256d *hi, __m256d *lo)
+{
+    __m256d p = _mm256_mul_pd(aHi, bHi);
+    __m256d e = _mm256_fmsub_pd(aHi, bHi, p);
+
+    e = _mm256_add_pd(e, _mm256_fmadd_pd(aHi, bLo, _mm256_mul_pd(aLo, bHi)));
+    ddQuickTwoSumAVX2(p, e, hi, lo);
+}
+
+// AVX2 double-double kernel, 4 pixels per vector, in the same way as escapeAVX2
+__attribute__((target("avx2,fma")))
+static void ddAVX2(const struct escapeWork *work, int n, int maxIterations, double epsilon, int *iterations, double *norms, struct escapeStats *stats)
+{
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const __m256d limit = _mm256_set1_pd(epsilon);
+    int k, i, j;
+
+    for (k = 0; k + 4 <= n; k += 4)
+    {
+        __m256d crHi = _mm256_loadu_pd(work->cr + k), crLo = _mm256_loadu_pd(work->crLo + k);
+        __m256d ciHi = _mm256_loadu_pd(work->ci + k), ciLo = _mm256_loadu_pd(work->ciLo + k);
+        __m256d reHi = _mm256_setzero_pd(), reLo = reHi, imHi = reHi, imLo = reHi;
+        __m256d re2Hi = reHi, re2Lo = reHi, im2Hi = reHi, im2Lo = reHi;
+        __m256d savedReHi = reHi, savedReLo = reHi, savedImHi = reHi, savedImLo = reHi;
+        __m256d norm = reHi, count = reHi, cycled = reHi;
+        __m256d active = _mm256_cmp_pd(reHi, reHi, _CMP_EQ_OQ);
+        long long save = 1;
+
+        for (i = 0; i < maxIterations; i++)
+        {
+            __m256d tHi, tLo;
+
+            // im = 2 re im + ci
+            ddMulAVX2(_mm256_add_pd(reHi, reHi), _mm256_add_pd(reLo, reLo), imHi, imLo, &tHi, &tLo);
+            ddAddAVX2(tHi, tLo, ciHi, ciLo, &imHi, &imLo);
+
+            // re = re^2 - im^2 + cr
+            ddAddAVX2(re2Hi, re2Lo, _mm256_xor_pd(im2Hi, sign), _mm256_xor_pd(im2Lo, sign), &tHi, &tLo);
+            ddAddAVX2(tHi, tLo, crHi, crLo, &reHi, &reLo);
+
+            ddMulAVX2(reHi, reLo, reHi, reLo, &re2Hi, &re2Lo);
+            ddMulAVX2(imHi, imLo, imHi, imLo, &im2Hi, &im2Lo);
+
+            __m256d mag = _mm256_add_pd(re2Hi, im2Hi);
+            __m256d escaped = _mm256_and_pd(_mm256_cmp_pd(mag, four, _CMP_GT_OQ), active);
+
+            // distance to the saved z, for the lanes that did not escape
+            __m256d dRe = _mm256_add_pd(_mm256_sub_pd(reHi, savedReHi), _mm256_sub_pd(reLo, savedReLo));
+            __m256d dIm = _mm256_add_pd(_mm256_sub_pd(imHi, savedImHi), _mm256_sub_pd(imLo, savedImLo));
+            __m256d distance = _mm256_add_pd(_mm256_andnot_pd(sign, dRe), _mm256_andnot_pd(sign, dIm));
+            __m256d periodic = _mm256_andnot_pd(escaped, _mm256_and_pd(_mm256_cmp_pd(distance, limit, _CMP_LT_OQ), active));
+
+            norm = _mm256_blendv_pd(norm, mag, _mm256_or_pd(escaped, periodic));
+            cycled = _mm256_or_pd(cycled, periodic);
+            active = _mm256_andnot_pd(_mm256_or_pd(escaped, periodic), active);
+
+            if (_mm256_movemask_pd(active) == 0)
+                break;
+
+            count = _mm256_add_pd(count, _mm256_and_pd(active, one));
+
+            if (i + 1 == save)
+            {
+                savedReHi = reHi;
+                savedReLo = reLo;
+                savedImHi = imHi;
+                savedImLo = imLo;
+                save *= 2;
+            }
+        }
+
+        // lanes that never escaped keep the last |z|^2
+        norm = _mm256_blendv_pd(norm, _mm256_add_pd(re2Hi, im2Hi), active);
+
+        _mm_storeu_si128((__m128i *)(iterations + k), _mm256_cvtpd_epi32(count));
+        _mm256_storeu_pd(norms + k, norm);
+
+        // the vector ran until its last lane finished
+        stats->slots += 4 * escapeCost(i, maxIterations);
+
+        for (j = 0; j < 4; j++)
+        {
+            stats->active += escapeCost(iterations[k + j], maxIterations);
+
+            // periodic lanes belong to the set
+            if ((_mm256_movemask_pd(cycled) >> j) & 1)
+            {
+                iterations[k + j] = maxIterations;
+                stats->cycles++;
+            }
+        }
+    }
+
+    // remaining pixels of the run
+    for (; k < n; k++)
+    {
+        struct dd cr = {work->cr[k], work->crLo[k]}, ci = {work->ci[k], work->ciLo[k]};
+
+        iterations[k] = ddPoint(cr, ci, maxIterations, epsilon, &norms[k], stats);
+    }
+}
+
+#endif
+
+// Double-double kernel selected by precisionInit
+static void (*ddRun)(const struct escapeWork *work, int n, int maxIterations, double epsilon, int *iterations, double *norms, struct escapeStats *stats) = ddScalar;
+
+
+/*---- Quad ---------------------------------------------------------------*/
+
+#ifdef __SIZEOF_FLOAT128__
+
+// Iterates a single point in __float128, like escapePoint
+static int quadPoint(__float128 cr, __float128 ci, int maxIterations, __float128 epsilon, double *norm, struct escapeStats *stats)
+{
+    __float128 re = 0, im = 0, re2 = 0, im2 = 0;
+    __float128 savedRe = 0, savedIm = 0;
+    long long save = 1;
+    int i;
+
+    for (i = 0; i < maxIterations; i++)
+    {
+        im = 2 * re * im + ci;
+        re = re2 - im2 + cr;
+        re2 = re * re;
+        im2 = im * im;
+
+        //if the point is outside the circle with radius 2: stop
+        if ((re2 + im2) > 4)
+            break;
+
+        // the orbit is back where it was: it repeats forever
+        __float128 dRe = re - savedRe, dIm = im - savedIm;
+
+        if ((dRe < 0 ? -dRe : dRe) + (dIm < 0 ? -dIm : dIm) < epsilon)
+        {
+            stats->cycles++;
+            stats->slots += i + 1;
+            stats->active += i + 1;
+
+            *norm = (double)(re2 + im2);
+            return maxIterations;
+        }
+
+        if (i + 1 == save)
+        {
+            savedRe = re;
+            savedIm = im;
+            save *= 2;
+        }
+    }
+
+    stats->slots += escapeCost(i, maxIterations);
+    stats->active += escapeCost(i, maxIterations);
+
+    *norm = (double)(re2 + im2);
+    return i;
+}
+
+// Center of the view in quad precision
+static __float128 precisionQuadRe, precisionQuadIm;
+
+// Reads a decimal number such as -0.74364388703715870475219150611477 or 1.25e-3 into q
+// Returns 0, or -1 if text is not a number
+static int quadParse(__float128 *q, const char *text)
+{
+    __float128 value = 0, scale = 1;
+    int digits = 0, fraction = 0, point = 0, exponent = 0, neg = 0;
+
+    while (isspace((unsigned char)*text))
+        text++;
+
+    if (*text == '-' || *text == '+')
+        neg = (*text++ == '-');
+
+    for (; *text != '\0'; text++)
+    {
+        if (isdigit((unsigned char)*text))
+        {
+            value = value * 10 + (*text - '0');
+            fraction += point;
+            digits++;
+        }
+        else if (*text == '.' && !point)
+            point = 1;
+        else
+            break;
+    }
+
+    if (digits == 0)
+        return -1;
+
+    if (*text == 'e' || *text == 'E')
+        exponent = atoi(text + 1);
+
+    exponent -= fraction;
+
+    for (; exponent < 0; exponent++)
+        scale *= 10;
+
+    for (; exponent > 0; exponent--)
+        value *= 10;
+
+    *q = neg ? -value / scale : value / scale;
+
+    return 0;
+}
+
+#endif
+
+
+/*---- Selection ---------------------------------------------------------------*/
+
+// Selects the cheapest precision in which the pixels of the view are distinct, unless MANDELBROT_PRECISION forces one
+// view holds the zoom and the center already read by viewInit; escapeInit has to run first
+static void precisionInit(const struct view *view, int maxIterations)
+{
+    const char *forced = getenv("MANDELBROT_PRECISION");
+    const char *re = getenv("MANDELBROT_CENTER_RE");
+    const char *im = getenv("MANDELBROT_CENTER_IM");
+
+    // |z| reaches 2 and the coordinates are rounded relative to the largest of them
+    double scale = fmax(2, fmax(fabs(view->moveX), fabs(view->moveY)));
+
+    precisionSpacing = fmin(1.5 / (0.5 * view->zoom * view->w), 1 / (0.5 * view->zoom * view->h));
+
+    if (forced != NULL && strcmp(forced, "float") == 0)
+        precisionLevel = PRECISION_FLOAT;
+    else if (forced != NULL && strcmp(forced, "quad") == 0)
+        precisionLevel = PRECISION_QUAD;
+    else if (forced != NULL && strcmp(forced, "double-double") == 0)
+        precisionLevel = PRECISION_DD;
+    else if (forced != NULL && strcmp(forced, "double") == 0)
+        precisionLevel = PRECISION_DOUBLE;
+    else if (precisionSpacing > scale * ldexp(1, -23) * PRECISION_FLOAT_MARGIN)
+        precisionLevel = PRECISION_FLOAT;
+    else if (precisionSpacing > scale * ldexp(1, -52) * PRECISION_MARGIN)
+        precisionLevel = PRECISION_DOUBLE;
+    else if (precisionSpacing > scale * ldexp(1, -104) * PRECISION_MARGIN)
+        precisionLevel = PRECISION_DD;
+    else
+        precisionLevel = PRECISION_QUAD;
+
+#ifdef __SIZEOF_FLOAT128__
+    if (re == NULL || quadParse(&precisionQuadRe, re) != 0)
+        precisionQuadRe = view->moveX;
+
+    if (im == NULL || quadParse(&precisionQuadIm, im) != 0)
+        precisionQuadIm = view->moveY;
+
+    precisionCenterRe.hi = (double)precisionQuadRe;
+    precisionCenterRe.lo = (double)(precisionQuadRe - precisionCenterRe.hi);
+    precisionCenterIm.hi = (double)precisionQuadIm;
+    precisionCenterIm.lo = (double)(precisionQuadIm - precisionCenterIm.hi);
+#else
+    (void)re;
+    (void)im;
+
+    // without __float128 the center is only known in double
+    precisionCenterRe.hi = view->moveX;
+    precisionCenterIm.hi = view->moveY;
+    precisionCenterRe.lo = precisionCenterIm.lo = 0;
+
+    if (precisionLevel == PRECISION_QUAD)
+        precisionLevel = PRECISION_DD;
+#endif
+
+    ddRun = ddScalar;
+    floatRun = floatScalar;
+
+#ifdef ESCAPE_X86
+    // the vector kernels follow MANDELBROT_ISA through the kernel escapeInit selected
+    if (strcmp(escapeIsa, "scalar") != 0)
+    {
+        ddRun = ddAVX2;
+        floatRun = (strcmp(escapeIsa, "avx512") == 0) ? floatAVX512 : floatAVX2;
+    }
+#endif
+
+    // there are no float stream kernels: MANDELBROT_KERNEL=stream keeps the pixels in double with the stream kernel
+    if (precisionLevel == PRECISION_FLOAT && strcmp(escapeMode, "stream") == 0)
+        precisionLevel = PRECISION_DOUBLE;
+
+    // float is kept, chosen or forced, only if the sampled rows end in the same iterations as in double
+    if (precisionLevel == PRECISION_FLOAT)
+    {
+        precisionMismatches = floatSample(view, maxIterations, &precisionCrossed, &precisionSamples);
+
+        if (precisionCrossed > 0 || precisionMismatches > PRECISION_FLOAT_MISMATCHES)
+            precisionLevel = PRECISION_DOUBLE;
+    }
+
+    precisionName = (precisionLevel == PRECISION_QUAD) ? "quad" : (precisionLevel == PRECISION_DD) ? "double-double" : (precisionLevel == PRECISION_DOUBLE) ? "double" : "float";
+}
+
+
+/*---- Rows ---------------------------------------------------------------*/
+
+// Iterates the n pixels of row y starting at column x0 in the selected precision, like escapeRow
+static void precisionRow(const struct view *view, int y, int x0, int n, int maxIterations, struct escapeWork *work)
+{
+    int k, j, m = 0;
+
+    if (precisionLevel == PRECISION_DOUBLE)
+    {
+        escapeRow(view, y, x0, n, maxIterations, work);
+        return;
+    }
+
+    if (precisionLevel == PRECISION_FLOAT)
+    {
+        for (k = 0; k < n; k++)
+        {
+            work->cr[k] = pixelRe(view, x0 + k);
+            work->ci[k] = pixelIm(view, y);
+        }
+
+        escapePointsWith(work, n, maxIterations, floatRun);
+        return;
+    }
+
+    // the offsets from the center are small, in double they are as precise as the pixel spacing needs
+    struct dd ci = ddAdd(precisionCenterIm, (struct dd){(y - view->h / 2) / (0.5 * view->zoom * view->h), 0});
+
+    // moves the pixels that still have to be iterated to the front of the run, like escapePoints
+    for (k = 0; k < n; k++)
+    {
+        struct dd cr = ddAdd(precisionCenterRe, (struct dd){1.5 * (x0 + k - view->w / 2) / (0.5 * view->zoom * view->w), 0});
+
+        if (escapeCheckInterior && escapeInterior(cr.hi, ci.hi))
+            continue;
+
+        work->cr[m] = cr.hi;
+        work->crLo[m] = cr.lo;
+        work->ci[m] = ci.hi;
+        work->ciLo[m] = ci.lo;
+        work->index[m++] = k;
+    }
+
+    work->stats.interior += n - m;
+
+    // a few hundred ulps of the wider type, as ESCAPE_CYCLE_EPSILON is for double
+    if (precisionLevel == PRECISION_DD)
+    {
+        ddRun(work, m, maxIterations, ldexp(escapeCycleEpsilon, -52), work->iterations, work->norms, &work->stats);
+    }
+
+#ifdef __SIZEOF_FLOAT128__
+    else
+    {
+        // the real coordinates are computed again from the quad center, which has 7 more bits than the double-double one
+        __float128 pi = precisionQuadIm + (__float128)((y - view->h / 2) / (0.5 * view->zoom * view->h));
+        __float128 epsilon = (__float128)escapeCycleEpsilon / ((__float128)(1ULL << 60));
+
+        for (k = 0; k < m; k++)
+        {
+            __float128 pr = precisionQuadRe + (__float128)(1.5 * (x0 + work->index[k] - view->w / 2) / (0.5 * view->zoom * view->w));
+
+            work->iterations[k] = quadPoint(pr, pi, maxIterations, epsilon, &work->norms[k], &work->stats);
+        }
+    }
+#endif
+
+    // spreads the results back to their pixels, from the end so none is overwritten before it is moved
+    for (k = n - 1, j = m - 1; k >= 0; k--)
+    {
+        if (j >= 0 && work->index[j] == k)
+        {
+            work->iterations[k] = work->iterations[j];
+            work->norms[k] = work->norms[j];
+            j--;
+        }
+        else
+        {
+            work->iterations[k] = maxIterations;
+            work->norms[k] = 0;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,354 @@
+//
+//  mandelbrot-progressive.h
+//
+//
+//  Progressive coarse-to-fine rendering engine, used instead of iterating
+//  every pixel when MANDELBROT_ENGINE=progressive.
+//
+//  Every PROGRESSIVE_STEP-th pixel of every PROGRESSIVE_STEP-th row is
+//  iterated first (and the last row and column, so the grid covers the
+//  image). The passes that follow halve the step: the grid is a set of
+//  blocks whose four corners are known, and each block either
+//
+//  - is filled, when its four corners escaped in the same iteration: its
+//    pixels take that iteration and the final |z|^2 interpolated between
+//    the corners (interior blocks stay interior), or
+//  - has its edge midpoints and center iterated, which makes the corners
+//    of the four blocks of the next pass.
+//
+//  Smooth exterior regions and the inside of the set are filled from a
+//  few samples, while the blocks along the boundary of the set are
+//  refined down to single pixels. A thin filament passing between the
+//  corners of a block with equal escape counts can be missed, so
+//  MANDELBROT_PROGRESSIVE=exact iterates every block instead: the image
+//  is then the same as with the per-pixel loop, only calculated in a
+//  coarse-to-fine order.
+//
+//  The programs can iterate the coarse grid of the whole image first,
+//  write it as a preview (MANDELBROT_PREVIEW names the file) and use it
+//  as the first pass of every band they render.
+//
+//  The samples are iterated in double precision, with the kernel selected
+//  by escapeInit.
+//
+
+#ifndef MANDELBROT_PROGRESSIVE_H
+#define MANDELBROT_PROGRESSIVE_H
+
+#include <omp.h>
+#include <stdio.h>
+
+#include "mandelbrot-kernel.h"
+
+// Distance between the pixels of the first pass, a power of two
+#define PROGRESSIVE_STEP 8
+
+// State of a pixel of the rows being rendered
+#define PROGRESSIVE_UNKNOWN 0
+#define PROGRESSIVE_PENDING 1
+#define PROGRESSIVE_ITERATED 2
+#define PROGRESSIVE_FILLED 3
+
+// Pixels filled by interpolation without iterating, by this process
+static long long progressiveFilled = 0;
+
+// Coarse grid of the whole image, iterated by progressiveCoarseInit, or NULL
+static int *progressiveCoarseIterations = NULL;
+static double *progressiveCoarseNorms = NULL;
+
+// Whether MANDELBROT_ENGINE selects this engine instead of the per-pixel loop
+static int progressiveSelected(void)
+{
+    const char *engine = getenv("MANDELBROT_ENGINE");
+
+    return engine != NULL && strcmp(engine, "progressive") == 0;
+}
+
+// Whether MANDELBROT_PROGRESSIVE=exact iterates every block instead of filling the uniform ones
+static int progressiveExact(void)
+{
+    const char *mode = getenv("MANDELBROT_PROGRESSIVE");
+
+    return mode != NULL && strcmp(mode, "exact") == 0;
+}
+
+// Points of the coarse grid along a side of n pixels: every PROGRESSIVE_STEP-th one and the last one
+static int progressiveCoarseCount(int n)
+{
+    return (n - 1 + PROGRESSIVE_STEP - 1) / PROGRESSIVE_STEP + 1;
+}
+
+// Pixel of the k-th point of the coarse grid along a side of n pixels
+static int progressiveCoarsePixel(int k, int n)
+{
+    return (k * PROGRESSIVE_STEP < n - 1) ? k * PROGRESSIVE_STEP : n - 1;
+}
+
+// Iterates the coarse grid of the whole image into progressiveCoarseIterations and progressiveCoarseNorms
+// Opens its own parallel region; called from inside one, the grid is iterated by the calling thread only
+static inline void progressiveCoarseInit(const struct view *view, int maxIterations)
+{
+    int columns = progressiveCoarseCount(view->w), rows = progressiveCoarseCount(view->h);
+    int j;
+
+    progressiveCoarseIterations = malloc(sizeof(int) * columns * rows);
+    progressiveCoarseNorms = malloc(sizeof(double) * columns * rows);
+
+    #pragma omp parallel private(j) if (!omp_in_parallel())
+    {
+        struct escapeWork work;
+        int k;
+
+        escapeWorkInit(&work, columns);
+
+        #pragma omp for schedule(dynamic)
+        for (j = 0; j < rows; j++)
+        {
+            for (k = 0; k < columns; k++)
+            {
+                work.cr[k] = pixelRe(view, progressiveCoarsePixel(k, view->w));
+                work.ci[k] = pixelIm(view, progressiveCoarsePixel(j, view->h));
+            }
+
+            escapePoints(&work, columns, maxIterations);
+
+            memcpy(progressiveCoarseIterations + j * columns, work.iterations, sizeof(int) * columns);
+            memcpy(progressiveCoarseNorms + j * columns, work.norms, sizeof(double) * columns);
+        }
+
+        escapeWorkFree(&work);
+    }
+}
+
+// Writes the coarse grid, already converted into columns x rows R, G, B pixels, as a PPM image to path
+static inline void progressivePreview(const char *path, const unsigned char *pixels, int columns, int rows)
+{
+    FILE *file = fopen(path, "wb");
+
+    if (file == NULL)
+    {
+        perror("Error writing the preview");
+        return;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", columns, rows);
+    fwrite(pixels, 3, (size_t)columns * rows, file);
+    fclose(file);
+}
+
+// Rows being rendered: rows y0..y1 (both included) of the image, view->w pixels each
+struct progressiveRows
+{
+    const struct view *view;
+    int y0, y1, maxIterations;
+    int *iterations;
+    double *norms;
+    unsigned char *state;
+};
+
+// Iterates the pending pixels of every row, rows handed out to the threads of the enclosing parallel region
+static void progressiveIterate(const struct progressiveRows *rows, struct escapeWork *work, int *columns)
+{
+    int w = rows->view->w, y;
+
+    #pragma omp for schedule(dynamic)
+    for (y = rows->y0; y <= rows->y1; y++)
+    {
+        size_t row = (size_t)(y - rows->y0) * w;
+        int x, k, n = 0;
+
+        for (x = 0; x < w; x++)
+        {
+            if (rows->state[row + x] == PROGRESSIVE_PENDING)
+            {
+                columns[n] = x;
+                work->cr[n] = pixelRe(rows->view, x);
+                work->ci[n++] = pixelIm(rows->view, y);
+            }
+        }
+
+        if (n == 0)
+            continue;
+
+        escapePoints(work, n, rows->maxIterations);
+
+        for (k = 0; k < n; k++)
+        {
+            rows->iterations[row + columns[k]] = work->iterations[k];
+            rows->norms[row + columns[k]] = work->norms[k];
+            rows->state[row + columns[k]] = PROGRESSIVE_ITERATED;
+        }
+    }
+}
+
+// Marks a pixel to be iterated unless it is already known
+static inline void progressiveMark(const struct progressiveRows *rows, int x, int y)
+{
+    unsigned char *state = &rows->state[(size_t)(y - rows->y0) * rows->view->w + x];
+
+    if (*state == PROGRESSIVE_UNKNOWN)
+        *state = PROGRESSIVE_PENDING;
+}
+
+// Fills or marks for iterating the blocks of side 2 * half whose corners are known
+// Blocks of alternate block rows share no pixel, so each parity is handed out to the threads separately
+static void progressiveRefine(const struct progressiveRows *rows, int half, int exact)
+{
+    int w = rows->view->w, side = 2 * half;
+    int blockRows = (rows->y1 - rows->y0 + side - 1) / side;
+    int parity, r;
+
+    if (blockRows < 1)
+        blockRows = 1;
+
+    for (parity = 0; parity < 2; parity++)
+    {
+        long long filled = 0;
+
+        #pragma omp for schedule(dynamic)
+        for (r = parity; r < blockRows; r += 2)
+        {
+            int by = rows->y0 + r * side;
+            int ey = (by + side < rows->y1) ? by + side : rows->y1;
+            int bx = 0;
+
+            do
+            {
+                int ex = (bx + side < w - 1) ? bx + side : w - 1;
+                size_t top = (size_t)(by - rows->y0) * w, bottom = (size_t)(ey - rows->y0) * w;
+                int i = rows->iterations[top + bx];
+
+                // the four corners escaped together: the block is filled from them
+                if (!exact && rows->iterations[top + ex] == i && rows->iterations[bottom + bx] == i && rows->iterations[bottom + ex] == i)
+                {
+                    double n00 = rows->norms[top + bx], n10 = rows->norms[top + ex];
+                    double n01 = rows->norms[bottom + bx], n11 = rows->norms[bottom + ex];
+                    int x, y;
+
+                    for (y = by; y <= ey; y++)
+                    {
+                        size_t row = (size_t)(y - rows->y0) * w;
+                        double fy = (ey > by) ? (double)(y - by) / (ey - by) : 0;
+
+                        for (x = bx; x <= ex; x++)
+                        {
+                            double fx = (ex > bx) ? (double)(x - bx) / (ex - bx) : 0;
+
+                            if (rows->state[row + x] != PROGRESSIVE_UNKNOWN)
+                                continue;
+
+                            rows->iterations[row + x] = i;
+                            rows->norms[row + x] = (1 - fy) * ((1 - fx) * n00 + fx * n10) + fy * ((1 - fx) * n01 + fx * n11);
+                            rows->state[row + x] = PROGRESSIVE_FILLED;
+                            filled++;
+                        }
+                    }
+                }
+
+                // otherwise its edge midpoints and center become the corners of four smaller blocks
+                else
+                {
+                    if (bx + half < ex)
+                    {
+                        progressiveMark(rows, bx + half, by);
+                        progressiveMark(rows, bx + half, ey);
+                    }
+
+                    if (by + half < ey)
+                    {
+                        progressiveMark(rows, bx, by + half);
+                        progressiveMark(rows, ex, by + half);
+                    }
+
+                    if (bx + half < ex && by + half < ey)
+                        progressiveMark(rows, bx + half, by + half);
+                }
+
+                bx += side;
+            } while (bx < w - 1);
+        }
+
+        #pragma omp atomic
+        progressiveFilled += filled;
+    }
+}
+
+// Renders rows y0..y1-1 of the image into iterations and norms, which hold (y1 - y0) * view->w pixels
+// The rows are widened to the coarse grid rows around them, which are also iterated when no coarse grid of the
+// whole image was iterated. Opens its own parallel region; called from inside one, the rows are rendered by
+// the calling thread only
+static void progressiveRender(const struct view *view, int y0, int y1, int maxIterations, int *iterations, double *norms)
+{
+    int w = view->w, h = view->h;
+    int first = y0 / PROGRESSIVE_STEP * PROGRESSIVE_STEP;
+    int last = (y1 - 1 + PROGRESSIVE_STEP - 1) / PROGRESSIVE_STEP * PROGRESSIVE_STEP;
+    int exact = progressiveExact();
+    int half, y;
+
+    if (last > h - 1)
+        last = h - 1;
+
+    size_t count = (size_t)(last - first + 1) * w;
+    struct progressiveRows rows = {view, first, last, maxIterations, malloc(sizeof(int) * count), malloc(sizeof(double) * count), calloc(count, 1)};
+
+    #pragma omp parallel private(half, y) if (!omp_in_parallel())
+    {
+        struct escapeWork work;
+        int *columns = malloc(sizeof(int) * w);
+
+        escapeWorkInit(&work, w);
+
+        // first pass: the coarse grid, copied from the grid of the whole image when there is one
+        #pragma omp for schedule(static)
+        for (y = first; y <= last; y++)
+        {
+            int j = (y == h - 1) ? progressiveCoarseCount(h) - 1 : y / PROGRESSIVE_STEP;
+            int columnsCount = progressiveCoarseCount(w), k;
+            size_t row = (size_t)(y - first) * w;
+
+            if (y % PROGRESSIVE_STEP != 0 && y != h - 1)
+                continue;
+
+            for (k = 0; k < columnsCount; k++)
+            {
+                int x = progressiveCoarsePixel(k, w);
+
+                if (progressiveCoarseIterations != NULL)
+                {
+                    rows.iterations[row + x] = progressiveCoarseIterations[j * columnsCount + k];
+                    rows.norms[row + x] = progressiveCoarseNorms[j * columnsCount + k];
+                    rows.state[row + x] = PROGRESSIVE_ITERATED;
+                }
+
+                else
+                    rows.state[row + x] = PROGRESSIVE_PENDING;
+            }
+        }
+
+        progressiveIterate(&rows, &work, columns);
+
+        // each pass halves the side of the blocks
+        for (half = PROGRESSIVE_STEP / 2; half >= 1; half /= 2)
+        {
+            progressiveRefine(&rows, half, exact);
+            progressiveIterate(&rows, &work, columns);
+        }
+
+        // copies the rows that were asked for
+        #pragma omp for schedule(static)
+        for (y = y0; y < y1; y++)
+        {
+            memcpy(iterations + (size_t)(y - y0) * w, rows.iterations + (size_t)(y - first) * w, sizeof(int) * w);
+            memcpy(norms + (size_t)(y - y0) * w, rows.norms + (size_t)(y - first) * w, sizeof(double) * w);
+        }
+
+        escapeWorkFree(&work);
+        free(columns);
+    }
+
+    free(rows.iterations);
+    free(rows.norms);
+    free(rows.state);
+}
+
+#endif
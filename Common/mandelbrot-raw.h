@@ -0,0 +1,84 @@
+//
+//  mandelbrot-raw.h
+//
+//
+//  Raw output mode, selected with MANDELBROT_OUTPUT=raw.
+//
+//  Instead of a PPM image, the programs write what the kernel computed for
+//  every pixel: the escape iteration (maxIterations for the pixels inside
+//  the set) and the final |z|^2. The colors are then produced by the
+//  recolor tool (Recolor/mandelbrot-recolor.c), so a palette can be
+//  changed without rendering the image again.
+//
+//  The file starts with a text header, in the spirit of PPM:
+//
+//      MBRAW
+//      <width> <height>
+//      <maxIterations>
+//
+//  followed by width * height struct rawPixel records in image order, in
+//  the byte order of the machine that rendered it. The final |z|^2 is
+//  kept as a float, which is plenty for the smooth coloring and keeps each
+//  pixel at 8 bytes.
+//
+
+#ifndef MANDELBROT_RAW_H
+#define MANDELBROT_RAW_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// First line of a raw file
+#define RAW_MAGIC "MBRAW"
+
+// Escape iteration and final |z|^2 of a pixel
+struct rawPixel
+{
+    uint32_t iteration;
+    float norm;
+};
+
+// Whether MANDELBROT_OUTPUT selects the raw output instead of the PPM image
+static inline int rawSelected(void)
+{
+    const char *output = getenv("MANDELBROT_OUTPUT");
+
+    return output != NULL && strcmp(output, "raw") == 0;
+}
+
+// Writes the header of a raw file of a w x h image into header, which holds size bytes
+static inline void rawHeader(char *header, size_t size, int w, int h, int maxIterations)
+{
+    snprintf(header, size, RAW_MAGIC "\n%d %d\n%d\n", w, h, maxIterations);
+}
+
+// Reads the header of a raw file, leaving stream at the first pixel
+// Returns 0, or -1 if stream does not start with a raw header
+static inline int rawReadHeader(FILE *stream, int *w, int *h, int *maxIterations)
+{
+    char magic[8];
+
+    if (fscanf(stream, "%7s %d %d %d", magic, w, h, maxIterations) != 4 || strcmp(magic, RAW_MAGIC) != 0)
+        return -1;
+
+    // a single whitespace character separates the header from the pixels
+    fgetc(stream);
+
+    return *w > 0 && *h > 0 && *maxIterations > 0 ? 0 : -1;
+}
+
+// Stores the escape iteration and final |z|^2 of count pixels
+static inline void rawPixels(struct rawPixel *pixels, const int *iterations, const double *norms, int count)
+{
+    int p;
+
+    for (p = 0; p < count; p++)
+    {
+        pixels[p].iteration = iterations[p];
+        pixels[p].norm = norms[p];
+    }
+}
+
+#endif
@@ -0,0 +1,231 @@
+//
+//  mandelbrot-subdivide.h
+//
+//
+//  Mariani-Silver rendering engine, used instead of iterating every pixel
+//  when MANDELBROT_ENGINE=subdivide.
+//
+//  The rows to render are cut into square tiles whose borders are
+//  iterated first. A rectangle whose whole border ran to maxIterations
+//  lies inside the set (the set has no holes), so its interior is filled
+//  without iterating. Otherwise the rectangle is split in four through
+//  its middle row and column, which are iterated, and each quarter is
+//  handled the same way as an OpenMP task. Small rectangles are simply
+//  iterated.
+//
+//  Only interior rectangles are filled: the smooth coloring needs the
+//  final |z| of every exterior pixel, so a border with any other common
+//  escape count does not tell the color of the pixels inside it.
+//
+
+#ifndef MANDELBROT_SUBDIVIDE_H
+#define MANDELBROT_SUBDIVIDE_H
+
+#include <omp.h>
+
+#include "mandelbrot-kernel.h"
+
+// Side of the tiles the rows are cut into before subdividing
+#define SUBDIVIDE_TILE 64
+
+// Rectangles with at most this many interior pixels on a side are iterated instead of split
+#define SUBDIVIDE_MIN 4
+
+// Rows being rendered: the buffers hold rows y0, y0 + 1... of the image, view->w pixels each
+// Each thread iterates its lines in its own entry of works, which holds a line of the rows or of a tile
+struct subdivideRows
+{
+    const struct view *view;
+    int y0, maxIterations;
+    int *iterations;
+    double *norms;
+    struct escapeWork *works;
+};
+
+// Pixels filled without iterating by this process
+static long long subdivideFilled = 0;
+
+// Whether MANDELBROT_ENGINE selects this engine instead of the per-pixel loop
+static int subdivideSelected(void)
+{
+    const char *engine = getenv("MANDELBROT_ENGINE");
+
+    return engine != NULL && strcmp(engine, "subdivide") == 0;
+}
+
+// Iterates the n pixels of the line starting at (x, y) with step (dx, dy), in the buffers of work
+static void subdivideLine(const struct subdivideRows *rows, struct escapeWork *work, int x, int y, int dx, int dy, int n)
+{
+    int k;
+
+    if (n <= 0)
+        return;
+
+    for (k = 0; k < n; k++)
+    {
+        work->cr[k] = pixelRe(rows->view, x + k * dx);
+        work->ci[k] = pixelIm(rows->view, y + k * dy);
+    }
+
+    escapePoints(work, n, rows->maxIterations);
+
+    for (k = 0; k < n; k++)
+    {
+        int pos = (y + k * dy - rows->y0) * rows->view->w + x + k * dx;
+
+        rows->iterations[pos] = work->iterations[k];
+        rows->norms[pos] = work->norms[k];
+    }
+}
+
+// Whether every pixel of the line starting at (x, y) with step (dx, dy) ran to maxIterations
+static int subdivideInterior(const struct subdivideRows *rows, int x, int y, int dx, int dy, int n)
+{
+    int k;
+
+    for (k = 0; k < n; k++)
+    {
+        if (rows->iterations[(y + k * dy - rows->y0) * rows->view->w + x + k * dx] != rows->maxIterations)
+            return 0;
+    }
+
+    return 1;
+}
+
+// Renders the pixels inside the rectangle with corners (x0, y0) and (x1, y1), whose border is already iterated
+// Runs as a task, on any thread of the team: its lines are iterated in the work of that thread
+static void subdivideRect(const struct subdivideRows *rows, int x0, int y0, int x1, int y1)
+{
+    int insideW = x1 - x0 - 1, insideH = y1 - y0 - 1;
+    struct escapeWork *work = &rows->works[omp_get_thread_num()];
+    int x, y;
+
+    if (insideW <= 0 || insideH <= 0)
+        return;
+
+    // the border lies inside the set, so does everything it encloses
+    if (subdivideInterior(rows, x0, y0, 1, 0, x1 - x0 + 1) && subdivideInterior(rows, x0, y1, 1, 0, x1 - x0 + 1) &&
+        subdivideInterior(rows, x0, y0, 0, 1, y1 - y0 + 1) && subdivideInterior(rows, x1, y0, 0, 1, y1 - y0 + 1))
+    {
+        for (y = y0 + 1; y < y1; y++)
+        {
+            for (x = x0 + 1; x < x1; x++)
+            {
+                rows->iterations[(y - rows->y0) * rows->view->w + x] = rows->maxIterations;
+                rows->norms[(y - rows->y0) * rows->view->w + x] = 0;
+            }
+        }
+
+        #pragma omp atomic
+        subdivideFilled += (long long)insideW * insideH;
+
+        return;
+    }
+
+    // too small to be worth splitting
+    if (insideW <= SUBDIVIDE_MIN || insideH <= SUBDIVIDE_MIN)
+    {
+        for (y = y0 + 1; y < y1; y++)
+        {
+            subdivideLine(rows, work, x0 + 1, y, 1, 0, insideW);
+        }
+
+        return;
+    }
+
+    // iterates the middle row and column, which become borders of the four quarters
+    int xm = (x0 + x1) / 2, ym = (y0 + y1) / 2;
+
+    subdivideLine(rows, work, x0 + 1, ym, 1, 0, insideW);
+    subdivideLine(rows, work, xm, y0 + 1, 0, 1, ym - y0 - 1);
+    subdivideLine(rows, work, xm, ym + 1, 0, 1, y1 - ym - 1);
+
+    #pragma omp task
+    subdivideRect(rows, x0, y0, xm, ym);
+
+    #pragma omp task
+    subdivideRect(rows, xm, y0, x1, ym);
+
+    #pragma omp task
+    subdivideRect(rows, x0, ym, xm, y1);
+
+    #pragma omp task
+    subdivideRect(rows, xm, ym, x1, y1);
+}
+
+// Renders rows y0..y1-1 of the image into iterations and norms, which hold (y1 - y0) * view->w pixels
+// Opens its own parallel region; called from inside one, the rows are rendered by the calling thread only
+static void subdivideRender(const struct view *view, int y0, int y1, int maxIterations, int *iterations, double *norms)
+{
+    struct subdivideRows rows = {view, y0, maxIterations, iterations, norms, NULL};
+    int w = view->w;
+
+    // called from inside a parallel region, the calling thread is the only one of the team
+    int team = omp_in_parallel() ? 1 : omp_get_max_threads();
+
+    // number of tiles in each direction, the last ones may be smaller
+    int tilesX = (w - 1 + SUBDIVIDE_TILE - 1) / SUBDIVIDE_TILE;
+    int tilesY = (y1 - 1 - y0 + SUBDIVIDE_TILE - 1) / SUBDIVIDE_TILE;
+    int t;
+
+    if (tilesX < 1)
+        tilesX = 1;
+
+    if (tilesY < 1)
+        tilesY = 1;
+
+    rows.works = malloc(sizeof(struct escapeWork) * team);
+
+    #pragma omp parallel shared(rows) private(t) if (!omp_in_parallel())
+    {
+        // a line is at most a row of the image or a side of a tile
+        struct escapeWork *work = &rows.works[omp_get_thread_num()];
+
+        escapeWorkInit(work, (w > SUBDIVIDE_TILE) ? w : SUBDIVIDE_TILE);
+
+        // iterates the rows of the tile grid
+        #pragma omp for schedule(dynamic) nowait
+        for (t = 0; t <= tilesY; t++)
+        {
+            int y = (y0 + t * SUBDIVIDE_TILE < y1) ? y0 + t * SUBDIVIDE_TILE : y1 - 1;
+
+            if (t == 0 || y != y0 + (t - 1) * SUBDIVIDE_TILE)
+                subdivideLine(&rows, work, 0, y, 1, 0, w);
+        }
+
+        // iterates the columns of the tile grid, between the grid rows
+        #pragma omp for schedule(dynamic)
+        for (t = 0; t < (tilesX + 1) * tilesY; t++)
+        {
+            int column = t % (tilesX + 1), row = t / (tilesX + 1);
+            int x = (column * SUBDIVIDE_TILE < w) ? column * SUBDIVIDE_TILE : w - 1;
+            int top = y0 + row * SUBDIVIDE_TILE;
+            int bottom = (top + SUBDIVIDE_TILE < y1) ? top + SUBDIVIDE_TILE : y1 - 1;
+
+            if (column == 0 || x != (column - 1) * SUBDIVIDE_TILE)
+                subdivideLine(&rows, work, x, top + 1, 0, 1, bottom - top - 1);
+        }
+
+        // each tile is subdivided by its own task tree
+        #pragma omp single
+        {
+            for (t = 0; t < tilesX * tilesY; t++)
+            {
+                int tx = t % tilesX, ty = t / tilesX;
+                int left = tx * SUBDIVIDE_TILE, top = y0 + ty * SUBDIVIDE_TILE;
+                int right = (left + SUBDIVIDE_TILE < w) ? left + SUBDIVIDE_TILE : w - 1;
+                int bottom = (top + SUBDIVIDE_TILE < y1) ? top + SUBDIVIDE_TILE : y1 - 1;
+
+                #pragma omp task firstprivate(left, top, right, bottom)
+                subdivideRect(&rows, left, top, right, bottom);
+            }
+        }
+
+        // every task finished at the end of the single construct
+        escapeWorkFree(work);
+    }
+
+    free(rows.works);
+}
+
+#endif
@@ -0,0 +1,172 @@
+//
+//  mandelbrot-tiles.h
+//
+//
+//  2D tiles of the image, used instead of whole rows as the work units of
+//  the per-pixel loop (OMP program) and as the fragments handed out by
+//  the dynamic hybrid program when MANDELBROT_TILES is hilbert or morton.
+//
+//  A row of a wide image is a long, thin work unit, and the rows crossing
+//  the set boundary, the expensive ones, come one after the other. Square
+//  tiles are smaller and balanced in shape, and handing them out along a
+//  space-filling curve keeps the tiles calculated at the same time close
+//  to each other:
+//
+//  - hilbert: consecutive tiles usually share a side; the curve runs on
+//             a power-of-two grid covering the image, and where it leaves
+//             the image the next tile inside can be further away
+//  - morton:  Z-order, cheaper to compute, with occasional jumps
+//
+//  The side of the tiles is a power of two from 16 to 256, the largest
+//  one leaving at least TILES_MIN tiles, or MANDELBROT_TILE_SIZE pixels.
+//  The tiles of the last column and row are cut by the image border.
+//
+
+#ifndef MANDELBROT_TILES_H
+#define MANDELBROT_TILES_H
+
+#include <stdlib.h>
+#include <string.h>
+
+// Smallest number of tiles the automatic tile size leaves
+#define TILES_MIN 1024
+
+// Side of the tiles, tiles per row and column, and number of tiles (0 when rows are used)
+static int tileSide = 0, tilesX = 0, tilesY = 0, tileCount = 0;
+
+// Tiles in the order they are handed out, as y * tilesX + x
+static int *tileOrder = NULL;
+
+// Order of the tiles: "rows" when tiles are not used, "hilbert" or "morton"
+static const char *tileOrderName = "rows";
+
+// Tile and its position along the curve, sorted by tileInit
+struct tileKey
+{
+    long long key;
+    int tile;
+};
+
+// Whether MANDELBROT_TILES cut the image into tiles instead of rows
+static int tilesSelected(void)
+{
+    return tileCount > 0;
+}
+
+// Position of the cell (x, y) along the Hilbert curve filling an n x n grid, n a power of two
+static long long tileHilbert(int n, int x, int y)
+{
+    long long d = 0;
+    int s;
+
+    for (s = n / 2; s > 0; s /= 2)
+    {
+        int rx = (x & s) > 0, ry = (y & s) > 0;
+
+        d += (long long)s * s * ((3 * rx) ^ ry);
+
+        // rotates the quadrant so the curve enters and leaves it through the right corners
+        if (ry == 0)
+        {
+            int t;
+
+            if (rx == 1)
+            {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+
+            t = x;
+            x = y;
+            y = t;
+        }
+    }
+
+    return d;
+}
+
+// Position of the cell (x, y) along the Morton curve, the bits of x and y interleaved
+static long long tileMorton(int x, int y)
+{
+    long long d = 0;
+    int b;
+
+    for (b = 0; b < 31; b++)
+        d |= ((long long)((x >> b) & 1) << (2 * b)) | ((long long)((y >> b) & 1) << (2 * b + 1));
+
+    return d;
+}
+
+// Orders two tiles along the curve, for qsort
+static int tileCompare(const void *a, const void *b)
+{
+    long long ka = ((const struct tileKey *)a)->key, kb = ((const struct tileKey *)b)->key;
+
+    return (ka > kb) - (ka < kb);
+}
+
+// Cuts a w x h image into tiles ordered as MANDELBROT_TILES selects, when it is hilbert or morton
+static void tileInit(int w, int h)
+{
+    const char *order = getenv("MANDELBROT_TILES");
+    const char *size = getenv("MANDELBROT_TILE_SIZE");
+    struct tileKey *keys;
+    int n = 1, t;
+
+    if (order == NULL || (strcmp(order, "hilbert") != 0 && strcmp(order, "morton") != 0))
+        return;
+
+    tileOrderName = (strcmp(order, "hilbert") == 0) ? "hilbert" : "morton";
+
+    if (size != NULL && atoi(size) > 0)
+        tileSide = atoi(size);
+
+    else
+    {
+        // doubles the side while at least TILES_MIN tiles would be left
+        tileSide = 16;
+
+        while (tileSide < 256 && (long long)(w / (2 * tileSide)) * (h / (2 * tileSide)) >= TILES_MIN)
+            tileSide *= 2;
+    }
+
+    tilesX = (w + tileSide - 1) / tileSide;
+    tilesY = (h + tileSide - 1) / tileSide;
+    tileCount = tilesX * tilesY;
+
+    // the curve fills the smallest power-of-two grid covering the tiles, the cells outside the image are skipped
+    while (n < tilesX || n < tilesY)
+        n *= 2;
+
+    keys = malloc(sizeof(struct tileKey) * tileCount);
+
+    for (t = 0; t < tileCount; t++)
+    {
+        int x = t % tilesX, y = t / tilesX;
+
+        keys[t].key = (tileOrderName[0] == 'h') ? tileHilbert(n, x, y) : tileMorton(x, y);
+        keys[t].tile = t;
+    }
+
+    qsort(keys, tileCount, sizeof(struct tileKey), tileCompare);
+
+    tileOrder = malloc(sizeof(int) * tileCount);
+
+    for (t = 0; t < tileCount; t++)
+        tileOrder[t] = keys[t].tile;
+
+    free(keys);
+}
+
+// First column and row and size of the k-th tile handed out, in a w x h image
+static void tileRect(int k, int w, int h, int *x0, int *y0, int *tw, int *th)
+{
+    int tile = tileOrder[k];
+
+    *x0 = (tile % tilesX) * tileSide;
+    *y0 = (tile / tilesX) * tileSide;
+    *tw = (*x0 + tileSide < w) ? tileSide : w - *x0;
+    *th = (*y0 + tileSide < h) ? tileSide : h - *y0;
+}
+
+#endif
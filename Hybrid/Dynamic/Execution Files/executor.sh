@@ -1,6 +1,7 @@
 #!/bin/bash
 
-mpicc mandelbrot-hybrid-dynamic.c -fopenmp -lm -o mandelbrot-hybrid-dynamic
+# builds the program in the folder above, which includes ../../Common
+mpicc -O2 -fopenmp ../mandelbrot-hybrid-dynamic.c -o mandelbrot-hybrid-dynamic -lm
 
 cat names.txt | while read line 
 do
@@ -16,11 +16,35 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
 #include <time.h>
 #include <stdio.h>
+#include <sched.h>
 #include <omp.h>
 #include <mpi.h>
 
+#include "../../Common/mandelbrot-kernel.h"
+#include "../../Common/mandelbrot-subdivide.h"
+#include "../../Common/mandelbrot-progressive.h"
+#include "../../Common/mandelbrot-antialias.h"
+#include "../../Common/mandelbrot-perturbation.h"
+#include "../../Common/mandelbrot-precision.h"
+#include "../../Common/mandelbrot-output.h"
+#include "../../Common/mandelbrot-mpiio.h"
+#include "../../Common/mandelbrot-raw.h"
+#include "../../Common/mandelbrot-animation.h"
+#include "../../Common/mandelbrot-tiles.h"
+
+// Number of fragments assigned to a worker ahead of time, so it never waits for the master between fragments
+#define FRAGMENT_WINDOW 2
+
+// Frames of an animation kept by the master, the fragments of later frames wait until the oldest one is written
+#define FRAME_RING 4
+
+// Rows of each OpenMP task into which the threads of the master split their fragments
+#define MASTER_TASK_ROWS 4
+
 /*---- Declarations -------------------------------------------------------------------------
 *   Height h, Width d, and Number of Iterations maxIterations
 *   vary according with pre-determined combinations
@@ -54,29 +78,133 @@ int maxIterations = 10000;
 // Used to indicate the number of threads used on the execution of the code
 int numThreads = 0;
 
+// Zoom and position of the view
+double zoom = 1, moveX = -0.5, moveY = 0;
+
 // Number of fragments in which the image will be splitted.
 int splits = 1;
 
-// Structure with 3 values, corresponding to Red, Green, and Blue
-struct rgb
-{
-    int red, green, blue;
-};
+// Fragments of a single image: splits bands of rows, or the tiles selected by MANDELBROT_TILES
+int fragments = 1;
+
+// Next fragment to be calculated, shared by the master threads and the workers
+int nextFragment = 0;
+
+// Number of fragments calculated by the threads of the master
+int masterFragments = 0;
+
+// Pixel with 3 bytes, corresponding to Red, Green, and Blue
+typedef unsigned char pixel_t[3];
+
+// Whether the escape iterations and final |z|^2 are sent and written instead of the colors
+int raw = 0;
+
+// Whether the edges of the image are anti-aliased, MANDELBROT_AA without raw output or the perturbation engine
+int antialias = 0;
+
+// Size in bytes of a pixel, pixel_t or struct rawPixel in raw mode
+size_t pixelSize = sizeof(pixel_t);
+
+// Frames of an animation being calculated by the master, frame f is in slot f % FRAME_RING
+unsigned char *frameRing = NULL;
+
+// Fragments of the frame in each slot still being calculated
+int frameRemaining[FRAME_RING];
+
+// Tiles received by the master straight into the rows of the image: [cut by the right border][cut by the bottom border]
+MPI_Datatype tileTypes[2][2];
+
+// Window exposing the next fragment of the master to the other processes, with MANDELBROT_SCHEDULER=rma
+MPI_Win rmaWindow = MPI_WIN_NULL;
+
+// Fragments claimed by the threads of the master from the window
+int masterClaimed = 0;
+
+// Whether the master writes each fragment to its place in the output as soon as it has it, MANDELBROT_WRITER=pwrite
+int streaming = 0;
+
+// Fragment received by the master before it is written, when streaming
+unsigned char *streamBuffer = NULL;
+
+// Whether every process writes the fragments it calculated to MANDELBROT_FILE with MPI-IO, MANDELBROT_WRITER=mpiio
+int mpiio = 0;
+
+// How the fragments were scheduled: "master" hands them out, "rma" processes claim them from the window
+const char *schedulerName = "master";
+
+// Frames of the animation already written, in order
+int framesWritten = 0;
+
+// Fragments assigned to each worker and not received yet, in the order the worker sends them back
+int *workerQueue = NULL, *workerQueueFirst = NULL, *workerQueueLength = NULL;
+
+// Fragment held back for each worker because its frame has no slot yet (-1 if none), and whether the worker was told to stop
+int *workerParked = NULL, *workerStopped = NULL;
+
+// Fragments of the animation assigned to the workers whose result has not been received yet, and workers holding a fragment back
+int fragmentsOutstanding = 0, workersParked = 0;
 
 
 /*---- Declaring Functions ---------------------------------------------------------------*/
 
 // Initializes the pixels array to avoid possible problems with left over values
-void fillPixels(struct rgb *pixels);
+void fillPixels(unsigned char *pixels);
+
+// First row of a fragment, the remainder rows are spread over the fragments
+int fragmentRow(int fragment);
+
+// Writes the calculated pixels, after the header, to the output image or the raw file
+void printPixels(unsigned char *pixels);
+
+// Formats the PPM (or raw) header of the output image
+void imageHeader(char *header, size_t size);
+
+// Calculates the rows initialPos..finalPos-1 of the image (of a frame of the animation) into pixels, with the engine selected by MANDELBROT_ENGINE
+void calculateRows(unsigned char *pixels, int frame, int initialPos, int finalPos);
+
+// Calculates the tw x th tile at (x0, y0) into pixels, whose rows are stride pixels apart
+void calculateTile(unsigned char *pixels, int stride, int x0, int y0, int tw, int th);
+
+// Calculates the rows first..last-1 of the tw pixels wide rectangle at (x0, y0) of the view into pixels, whose rows are stride pixels apart
+// From the team of the master the rows are split into OpenMP tasks, so the threads out of fragments share them
+void calculateBand(const struct view *view, unsigned char *pixels, int stride, int x0, int y0, int tw, int first, int last);
+
+// Calculates a fragment, a tile or a band of rows, straight into its place in the image,
+// or apart when it is streamed to the output or kept for the MPI-IO write
+void calculateFragment(unsigned char *pixels, int fragment);
 
-// Joins the calculated Chunk of pixels to the complete Pixels array
-void joinPixels(struct rgb *pixels, struct rgb *tempPixels, int initialPos, int finalPos);
+// Receives the fragment whose message was probed into its place in the image
+void receiveFragment(unsigned char *pixels, MPI_Datatype MPI_PIXEL, MPI_Status *status);
 
-// Iterates through the calculated pixels sending them to be printed to the output image
-void printPixels(struct rgb *pixels);
+// Calculates fragments claimed from the window on the threads of the master and receives those of the workers
+void claimFragments(unsigned char *pixels, MPI_Datatype MPI_PIXEL, int provided);
 
-// Prints the received RGB colors to the output image
-void color(int red, int green, int blue);
+// Claims the next fragment from the window
+int claimFragment(void);
+
+// Iterates the coarse grid of the progressive engine for the whole image and writes it as the preview
+void progressivePass(void);
+
+// Calculates the frames of the animation with the workers and the threads of the master, writing them in order
+void animateFrames(MPI_Datatype MPI_PIXEL, int nworkers, int provided);
+
+// Whether the frame of a fragment of the animation has a slot in the ring
+int frameFits(int fragment);
+
+// Assigns a fragment of the animation to a worker, holds it back if its frame has no slot, or stops the worker
+void giveFragment(int worker, int fragment);
+
+// Counts a calculated fragment of a frame of the animation, writing the frames that are complete
+void fragmentDone(int frame);
+
+// Writes the complete frames following the ones already written, in order
+void writeFrames(void);
+
+// Converts the escape iteration and final |z|^2 of count pixels into their colors
+void colorPixels(pixel_t *pixels, const int *iterations, const double *norms, int count);
+
+// Stores count pixels as colors or, in raw mode, as the kernel left them
+void storePixels(unsigned char *pixels, const int *iterations, const double *norms, int count);
 
 // Calculates and prints execution time results and parameters
 void getResults(double begin, double end, double end2, int size);
@@ -108,25 +236,30 @@ int main(int argc, char *argv[])
 
     /*---- Variables ---------------------------------------------------------------*/
 
-    // Allocating space for all the pixels
-    struct rgb *pixels = malloc(sizeof(struct rgb) * imageSize);
-
     // variables used to calculate execution time
-    double begin, end, end2;
+    double begin = 0, end = 0, end2 = 0;
 
     // variables used by MPI
     int rank, size;
 
     // variables used on the master-worker process
-    int nworkers, aux, aux2;
+    int nworkers, aux2;
+
+    // Thread support given by MPI
+    int provided;
 
     // Value that represents the status of the received message.
     MPI_Status status;
 
     /*---- MPI --------------------------------------------------------*/
 
+    // MANDELBROT_SCHEDULER=rma: the fragments are claimed from a counter on the master instead of being handed out
+    int rma = getenv("MANDELBROT_SCHEDULER") != NULL && strcmp(getenv("MANDELBROT_SCHEDULER"), "rma") == 0;
+
     // Starts MPI and returns an error If something wrong happens
-    if (MPI_Init(&argc, &argv) != MPI_SUCCESS)
+    // Only the main thread of each process calls MPI, while the others calculate,
+    // except with the rma scheduler, where the threads of the master claim their own fragments
+    if (MPI_Init_thread(&argc, &argv, rma ? MPI_THREAD_MULTIPLE : MPI_THREAD_FUNNELED, &provided) != MPI_SUCCESS)
     {
         fprintf(stderr, "Error initilazing MPI\n");
         return 100;
@@ -138,118 +271,343 @@ int main(int argc, char *argv[])
     // Get number of processes
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
+    // Selects the widest SIMD kernel supported by the node running this process
+    escapeInit();
+
+    // MANDELBROT_ZOOM, MANDELBROT_CENTER_RE and MANDELBROT_CENTER_IM move the view, the perturbation engine
+    // computes the reference orbit of its center in every process, and the precision of the kernels is chosen for it
+    struct view view = {w, h, zoom, moveX, moveY};
+
+    viewInit(&view);
+    perturbInit(&view, maxIterations);
+    precisionInit(&view, maxIterations);
+
+    zoom = view.zoom;
+    moveX = view.moveX;
+    moveY = view.moveY;
+
+    // MANDELBROT_ANIMATION renders the frames of a keyframe file instead of a single image
+    if (animationInit() != 0)
+    {
+        if (rank == 0)
+        {
+            fprintf(stderr, "Error reading the keyframes of %s\n", getenv("MANDELBROT_ANIMATION"));
+        }
+
+        MPI_Finalize();
+        return 1;
+    }
+
+    // The reference orbit and the extended precision kernels belong to the center of a single view,
+    // the frames of an animation are calculated in double
+    if (animationFrames > 0 && perturbSelected())
+    {
+        if (rank == 0)
+        {
+            fprintf(stderr, "The perturbation engine renders single images, not animations\n");
+        }
+
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (animationFrames > 0)
+    {
+        precisionLevel = PRECISION_DOUBLE;
+        precisionName = "double";
+        precisionMismatches = -1;
+    }
+
+    // MANDELBROT_TILES: the fragments of an image calculated pixel by pixel are 2D tiles along a Hilbert or Morton curve
+    if (!subdivideSelected() && !perturbSelected() && !progressiveSelected() && animationFrames == 0)
+    {
+        tileInit(w, h);
+    }
+
+    fragments = tilesSelected() ? tileCount : splits;
+
+    // The counter of the rma scheduler lives in the master, the frames of an animation are always handed out by it
+    if (rma && animationFrames == 0)
+    {
+        int *counter;
+
+        MPI_Win_allocate(rank == 0 ? sizeof(int) : 0, sizeof(int), MPI_INFO_NULL, MPI_COMM_WORLD, &counter, &rmaWindow);
+
+        if (rank == 0)
+        {
+            *counter = 0;
+        }
+
+        MPI_Barrier(MPI_COMM_WORLD);
+
+        // Every process accesses the counter whenever it needs, without synchronising with the others
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, rmaWindow);
+
+        schedulerName = "rma";
+    }
+
     // Defining the number of Workers
     nworkers = size - 1;
 
-    // Determining the number of lines to bee calculated in each fragment
-    int fragmentHeight = h / splits;
 
+    /*---- Creating MPI_PIXEL type ------------------------------------------------------------------------------*/
 
-    /*---- Creating MPI_RGB struct ------------------------------------------------------------------------------*/
+    // Selects the raw output, in which the workers send the escape iterations and final |z|^2 instead of the colors
+    raw = rawSelected();
 
-    MPI_Datatype MPI_RGB;
+    // The sub-samples are colored and iterated in double precision, which the raw output and deep zooms cannot use
+    antialias = antialiasSelected() && !raw && !perturbSelected();
 
-    MPI_Datatype type[3] = {MPI_INT, MPI_INT, MPI_INT};
+    pixelSize = raw ? sizeof(struct rawPixel) : sizeof(pixel_t);
 
-    MPI_Type_commit(type);
+    // The frames of an animation in raw mode are raw files one after the other
+    animationY4m = animationY4m && !raw;
 
-    int blocklen[3] = {1, 1, 1};
+    // MANDELBROT_WRITER=mpiio: the pixels stay in the processes that calculated them, which write them to the file
+    mpiio = mpiioSelected() && animationFrames == 0;
 
-    MPI_Aint displacement[3] = {0, sizeof(int), sizeof(int) * 2};
+    if (rank == 0 && !mpiio && getenv("MANDELBROT_WRITER") != NULL && strcmp(getenv("MANDELBROT_WRITER"), "mpiio") == 0)
+    {
+        fprintf(stderr, "MANDELBROT_WRITER=mpiio needs MANDELBROT_FILE and a single image, the image is written to stdout by the master\n");
+    }
 
-    MPI_Type_create_struct(3, blocklen, displacement, type, &MPI_RGB);
-    
-    MPI_Type_commit(&MPI_RGB);
+    // A pixel travels with the same layout it has in memory: its 3 bytes, or a struct rawPixel
+    MPI_Datatype MPI_PIXEL;
 
+    if (raw)
+    {
+        MPI_Datatype type[2] = {MPI_UINT32_T, MPI_FLOAT};
 
-    /*---- Executing ------------------------------------------------------------------------------*/
+        int blocklen[2] = {1, 1};
 
-    /*---- Master --------*/
-    if (rank == 0)
+        MPI_Aint displacement[2] = {offsetof(struct rawPixel, iteration), offsetof(struct rawPixel, norm)};
+
+        MPI_Type_create_struct(2, blocklen, displacement, type, &MPI_PIXEL);
+    }
+
+    else
     {
+        MPI_Type_contiguous(3, MPI_UNSIGNED_CHAR, &MPI_PIXEL);
+    }
+
+    MPI_Type_commit(&MPI_PIXEL);
+
+    // A tile is received as th blocks of tw pixels, w pixels apart; the tiles of the last column and row are narrower
+    if (rank == 0 && tilesSelected())
+    {
+        int cutW = w - (tilesX - 1) * tileSide, cutH = h - (tilesY - 1) * tileSide;
+
+        MPI_Type_vector(tileSide, tileSide, w, MPI_PIXEL, &tileTypes[0][0]);
+        MPI_Type_vector(tileSide, cutW, w, MPI_PIXEL, &tileTypes[1][0]);
+        MPI_Type_vector(cutH, tileSide, w, MPI_PIXEL, &tileTypes[0][1]);
+        MPI_Type_vector(cutH, cutW, w, MPI_PIXEL, &tileTypes[1][1]);
+
+        for (aux2 = 0; aux2 < 4; aux2++)
+        {
+            MPI_Type_commit(&tileTypes[aux2 / 2][aux2 % 2]);
+        }
+    }
 
-        // Initializing  final image pixels array 
-        fillPixels(pixels);
 
+    /*---- Executing ------------------------------------------------------------------------------*/
+
+    /*---- Master of an animation --------*/
+    if (rank == 0 && animationFrames > 0)
+    {
         // start counting execution time
         begin = MPI_Wtime();
 
-        /*---- Printing Execution Details --------------------------------------------------------*/
+        // Calculates the frames, each one is written as soon as it and the frames before it are complete
+        animateFrames(MPI_PIXEL, nworkers, provided);
 
-        printf("P6\n# Original Code CREATOR: Eric R. Weeks / mandel program - Changes by: Daniel V. Cordeiro & Rafael C. Pereira\n");
-        printf("%d %d\n255\n", w, h);
+        // Stops counting execution time, the frames were written on the way
+        end = end2 = MPI_Wtime();
+    }
 
+    /*---- Master --------*/
+    else if (rank == 0)
+    {
+        // MANDELBROT_WRITER=pwrite: the header is written first and every fragment goes to its place in the output file
+        // as soon as it is calculated or received, only the fragments in the hands of the master are kept
+        if (getenv("MANDELBROT_WRITER") != NULL && strcmp(getenv("MANDELBROT_WRITER"), "pwrite") == 0)
+        {
+            char header[256];
 
-        /*---- Managing MPI Message Exchange and Image Calculation --------------------------------------------------------*/
+            imageHeader(header, sizeof(header));
 
-        // Counts how many messages (fragments) have already been received
-        int rcvdMsgs = 0;
+            streaming = outputStreamStart(header, pixelSize * imageSize) == 0;
 
-        // Sends the firts fragment for each "worker" MPI process
-        for (aux2 = 0; aux2 < nworkers; aux2++)
+            if (!streaming)
+            {
+                fprintf(stderr, "MANDELBROT_WRITER=pwrite needs MANDELBROT_FILE or stdout to be a regular file, the image is written to stdout at the end\n");
+            }
+        }
+
+        // Allocating space for all the pixels, the fragments are received straight into it,
+        // or, when streaming, for the fragment being received
+        unsigned char *pixels = (streaming || mpiio) ? NULL : malloc(pixelSize * imageSize);
+
+        streamBuffer = streaming ? malloc(pixelSize * (tilesSelected() ? tileSide * tileSide : (h + splits - 1) / splits * w)) : NULL;
+
+        // Initializing  final image pixels array 
+        if (pixels != NULL)
         {
-            MPI_Send(&aux2, 1, MPI_INT, aux2 + 1, rank, MPI_COMM_WORLD);
+            fillPixels(pixels);
         }
 
-        // Receives the messages (fragments) have already been calculated
-        for (aux = 0; aux < splits; aux++)
+        // start counting execution time
+        begin = MPI_Wtime();
+
+        /*---- Managing MPI Message Exchange and Image Calculation --------------------------------------------------------*/
+
+        // Every process claims its fragments from a counter on the master, which only receives the results
+        if (rmaWindow != MPI_WIN_NULL)
         {
-            // Allocating space for current chunk of pixels
-            struct rgb *rcvdPixels = malloc(sizeof(struct rgb) * imageSize);
+            progressivePass();
 
-            // Receiving calculated fragment of mandelbtrot
-            MPI_Recv(rcvdPixels, imageSize, MPI_RGB, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+            claimFragments(pixels, MPI_PIXEL, provided);
+        }
 
-            // From which process this message comes from
-            int source = status.MPI_SOURCE;
+        // The master hands out every fragment
+        else
+        {
+            // Number of fragments assigned to the workers whose result has not been received yet
+            int outstanding = 0;
 
-            // Fragment number
-            int tag = status.MPI_TAG;
+            // Whether each worker was already told to stop
+            int *stopped = calloc(size, sizeof(int));
 
-            // Calculating the initial position of that fragment
-            int initialPos = tag * fragmentHeight;
+            // Sends the first FRAGMENT_WINDOW fragments to each "worker" MPI process, or a signal to stop if the fragments run out
+            for (aux2 = 0; aux2 < nworkers * FRAGMENT_WINDOW; aux2++)
+            {
+                int worker = aux2 % nworkers + 1;
+                int first = (nextFragment < fragments) ? nextFragment++ : -1;
 
-            // Calculating the final position of that fragment
-            int finalPos = fragmentHeight * (tag + 1);
+                if (stopped[worker])
+                {
+                    continue;
+                }
 
-            // Joins the received fragment with the final complete image
-            joinPixels(pixels, rcvdPixels, initialPos, finalPos);
+                if (first == -1)
+                {
+                    stopped[worker] = 1;
+                }
 
-            // Deallocates the memory previously allocated
-            free(rcvdPixels);
+                else
+                {
+                    outstanding++;
+                }
 
-            // If this is not the last fragment, increase the fragment counter
-            if ((aux + nworkers) < splits)
-            {
-                rcvdMsgs = aux + nworkers;
+                MPI_Send(&first, 1, MPI_INT, worker, rank, MPI_COMM_WORLD);
             }
 
-            // Otherwise sets a signal to the worker to finish working
-            else
+            // While the workers calculate their first fragments
+            progressivePass();
+
+            // Thread 0 serves the workers, the other threads calculate fragments from the same queue
+            // Without thread support from MPI, or with a single thread, the master serves the workers before calculating
+            #pragma omp parallel if (provided >= MPI_THREAD_FUNNELED)
             {
-                rcvdMsgs = -1;
+                if (omp_get_thread_num() == 0)
+                {
+                    // Receives the messages (fragments) calculated by the workers until every assigned fragment came back
+                    while (outstanding > 0)
+                    {
+                        // Number of the next fragment for the worker
+                        int next;
+
+                        // Waits for the next calculated fragment to know where it goes
+                        MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+
+                        // From which process this message comes from
+                        int source = status.MPI_SOURCE;
+
+                        // Receiving calculated fragment of mandelbtrot straight into its place in the final image
+                        receiveFragment(pixels, MPI_PIXEL, &status);
+
+                        outstanding--;
+
+                        // A worker which was told to stop only finishes the fragments it already had
+                        if (stopped[source])
+                        {
+                            continue;
+                        }
+
+                        // Takes the next fragment of the queue
+                        #pragma omp atomic capture
+                        next = nextFragment++;
+
+                        // If the queue is empty, sets a signal to the worker to finish working
+                        if (next >= fragments)
+                        {
+                            next = -1;
+                            stopped[source] = 1;
+                        }
+
+                        else
+                        {
+                            outstanding++;
+                        }
+
+                        // Sends a message to the worker, either with the number of the next fragment to be calculated or to stop working
+                        MPI_Send(&next, 1, MPI_INT, source, source, MPI_COMM_WORLD);
+                    }
+                }
+
+                // Calculates fragments until the queue is empty
+                // Thread 0 only gets here once every worker stopped, which matters when there are no workers
+                while (1)
+                {
+                    // Number of the fragment calculated by this thread
+                    int pos;
+
+                    #pragma omp atomic capture
+                    pos = nextFragment++;
+
+                    if (pos >= fragments)
+                    {
+                        break;
+                    }
+
+                    // Calculates the tile or the rows of the fragment straight into the final image, on this thread only
+                    calculateFragment(pixels, pos);
+
+                    #pragma omp atomic
+                    masterFragments++;
+                }
             }
 
-            // Sends a message to the worker, either with the number of the next fragment to be calculated or to stop working
-            MPI_Send(&rcvdMsgs, 1, MPI_INT, source, source, MPI_COMM_WORLD);
+            free(stopped);
         }
 
         // Stops counting execution time 
         end = MPI_Wtime();
 
-        // Print calculated image
-        printPixels(pixels);
+        // Print calculated image, or finish the streamed one; with MPI-IO every process writes its own fragments below
+        if (streaming)
+        {
+            outputStreamEnd();
+        }
+
+        else if (!mpiio)
+        {
+            printPixels(pixels);
+        }
 
         // Stops counting execution time - taking into account printing time
         end2 = MPI_Wtime();
 
-        /*---- Results ------------------------------------------------------------------------------*/
-
-        // Calculates and prints execution data
-        getResults(begin, end, end2, size);
-
         // Deallocates the memory previously allocated
         free(pixels);
+        free(streamBuffer);
+
+        if (tilesSelected())
+        {
+            for (aux2 = 0; aux2 < 4; aux2++)
+            {
+                MPI_Type_free(&tileTypes[aux2 / 2][aux2 % 2]);
+            }
+        }
     }
 
     /*---- Worker --------*/
@@ -257,15 +615,51 @@ int main(int argc, char *argv[])
     else
     {
         /*---- Execution ------------------------------------------------------------------------------*/
-        
+
+        // Two buffers for the fragments, one of them is being sent while the other is being calculated
+        int maxFragmentSize = tilesSelected() ? tileSide * tileSide : (h + splits - 1) / splits * w;
+        unsigned char *localPixels[2] = {malloc(pixelSize * maxFragmentSize), malloc(pixelSize * maxFragmentSize)};
+
+        // Sends in flight from each buffer
+        MPI_Request requests[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+
+        // Buffer of the next fragment
+        int current = 0;
+
+        // With the rma scheduler, the claim of the next fragment is in flight while the current one is calculated
+        MPI_Request claim = MPI_REQUEST_NULL;
+        int one = 1, claimed = 0;
+
+        if (rmaWindow != MPI_WIN_NULL)
+        {
+            MPI_Rget_accumulate(&one, 1, MPI_INT, &claimed, 1, MPI_INT, 0, 0, 1, MPI_INT, MPI_SUM, rmaWindow, &claim);
+        }
+
         // Execute forever (or until receive a comand to stop)
         while (1)
         {
             // Number of fragment
             int pos = 0;
 
+            // Takes the fragment claimed from the window, and claims the next one; past the last fragment it stops
+            if (rmaWindow != MPI_WIN_NULL)
+            {
+                MPI_Wait(&claim, MPI_STATUS_IGNORE);
+
+                pos = (claimed < fragments) ? claimed : -1;
+
+                if (pos != -1)
+                {
+                    MPI_Rget_accumulate(&one, 1, MPI_INT, &claimed, 1, MPI_INT, 0, 0, 1, MPI_INT, MPI_SUM, rmaWindow, &claim);
+                }
+            }
+
             // Receiving information about the fragment to be calculated
-            MPI_Recv(&pos, 1, MPI_INT, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+            // The master keeps FRAGMENT_WINDOW fragments assigned ahead, so the number is usually already here
+            else
+            {
+                MPI_Recv(&pos, 1, MPI_INT, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+            }
 
             // If it is a "-1" it is a message to stop working
             if (pos == -1)
@@ -273,102 +667,111 @@ int main(int argc, char *argv[])
                 break;
             }
 
+            // MPI-IO: the fragment is kept for the file, the master is only told that it is done
+            else if (mpiio)
+            {
+                calculateFragment(NULL, pos);
+
+                MPI_Send(NULL, 0, MPI_PIXEL, 0, pos, MPI_COMM_WORLD);
+            }
+
+            // Calculate the Mandelbrot tile
+            else if (tilesSelected())
+            {
+                // position and size of that tile
+                int x0, y0, tw, th;
+
+                tileRect(pos, w, h, &x0, &y0, &tw, &th);
+
+                // Waits until the previous tile in this buffer was sent before overwriting it
+                MPI_Wait(&requests[current], MPI_STATUS_IGNORE);
+
+                // Calculates the tile, its rows one after the other
+                calculateTile(localPixels[current], tw, x0, y0, tw, th);
+
+                // Sends back to the master process the calculated tile while the next one is calculated
+                MPI_Isend(localPixels[current], tw * th, MPI_PIXEL, 0, pos, MPI_COMM_WORLD, &requests[current]);
+
+                current = 1 - current;
+            }
+
             // Calculate the Mandelbrot fragment
             else
             {
-                // variables used for iteration
-                int x, y;
-
-                // variable to hold 1 calculated pixel colors [R, G ,B]
-                struct rgb pixel;
+                // In an animation the fragments of every frame are numbered one after the other
+                int frame = pos / splits, fragment = pos % splits;
 
                 // initial position of that fragment
-                int initialPos = pos * fragmentHeight;
+                int initialPos = fragmentRow(fragment);
 
                 // final position of that fragment
-                int finalPos = fragmentHeight * (pos+1);
-
-                // real and imaginary part of the pixel p
-                double pr, pi;
+                int finalPos = fragmentRow(fragment + 1);
 
-                // real and imaginary parts of new and old z
-                double newRe, newIm, oldRe, oldIm;
+                // Waits until the previous fragment in this buffer was sent before overwriting it
+                MPI_Wait(&requests[current], MPI_STATUS_IGNORE);
 
-                // zoom and position
-                double zoom = 1, moveX = -0.5, moveY = 0;
+                // Calculates the rows of the fragment
+                calculateRows(localPixels[current], frame, initialPos, finalPos);
 
-                // Allocating space for the pixels in this rank
-                struct rgb *localPixels = malloc(sizeof(struct rgb) * imageSize);
-
-                // Beginning of the OMP parallel section
-                #pragma omp parallel shared(zoom, moveX, moveY, localPixels, initialPos) private(y, x, pr, pi, newRe, newIm, oldRe, oldIm, pixel)
-                {
-                    // Determining the scheduling type of the loop - dynamic
-                    // OpenMP divides the iterations into chunks of default size
-                    #pragma omp for schedule(dynamic)
-                    
-                    //loop through every pixel
-                    for (y = initialPos; y < finalPos; y++)
-                    {
-                        for (x = 0; x < w; x++)
-                        {
-                            // calculate the initial real and imaginary part of z, based on the pixel location and zoom and position values
-                            pr = 1.5 * (x - w / 2) / (0.5 * zoom * w) + moveX;
-                            pi = (y - h / 2) / (0.5 * zoom * h) + moveY;
-                            newRe = newIm = oldRe = oldIm = 0; //these should start at 0,0
-
-                            // "i" will represent the number of iterations
-                            int i;
-
-                            // start the iteration process
-                            for (i = 0; i < maxIterations; i++)
-                            {
-                                // remember value of previous iteration
-                                oldRe = newRe;
-                                oldIm = newIm;
-                                //the actual iteration, the real and imaginary part are calculated
-                                newRe = oldRe * oldRe - oldIm * oldIm + pr;
-                                newIm = 2 * oldRe * oldIm + pi;
-
-                                //if the point is outside the circle with radius 2: stop
-                                if ((newRe * newRe + newIm * newIm) > 4)
-                                    break;
-                            }
-
-                            // Calculates position of the current calculated pixel
-                            int posLocal = (y - initialPos) * w + x;
-
-                            // color(i % 256, 255, 255 * (i < maxIterations));
-                            if (i == maxIterations)
-                            {
-                                //color(0, 0, 0); // black
-                                pixel.red = 0;
-                                pixel.green = 0;
-                                pixel.blue = 0;
-                            }
-
-                            else
-                            {
-                                double z = sqrt(newRe * newRe + newIm * newIm);
-                                int brightness = 256 * log2(1.75 + i - log2(log2(z))) / log2((double)maxIterations);
-                                
-                                //color(brightness, brightness, 255);
-                                pixel.red = brightness;
-                                pixel.green = brightness;
-                                pixel.blue = 255;
-                            }
-
-                            // Putting the calculated pixel in the fragment array
-                            localPixels[posLocal] = pixel;
-                        }
-                    }
-                    // End of the OMP parallel section
-                }
+                // Sends back to the master process the calculated fragment while the next one is calculated
+                MPI_Isend(localPixels[current], (finalPos - initialPos) * w, MPI_PIXEL, 0, fragment, MPI_COMM_WORLD, &requests[current]);
 
-                // Sends back to the master process the calculated fragment
-                MPI_Send(localPixels, imageSize, MPI_RGB, 0, pos, MPI_COMM_WORLD);
+                current = 1 - current;
             }
         }
+
+        // Waits for the last fragments to be sent
+        MPI_Waitall(2, requests, MPI_STATUSES_IGNORE);
+
+        // Deallocates the memory previously allocated
+        free(localPixels[0]);
+        free(localPixels[1]);
+    }
+
+    // Every claim was completed, the window is released
+    if (rmaWindow != MPI_WIN_NULL)
+    {
+        MPI_Win_unlock_all(rmaWindow);
+        MPI_Win_free(&rmaWindow);
+    }
+
+    // MPI-IO: every process writes the fragments it calculated, rank 0 the header too
+    if (mpiio)
+    {
+        char header[256];
+
+        imageHeader(header, sizeof(header));
+
+        mpiioWrite(header, MPI_PIXEL, pixelSize, imageSize);
+        mpiioFree();
+
+        // Stops counting execution time - taking into account printing time
+        end2 = MPI_Wtime();
+    }
+
+    /*---- Results ------------------------------------------------------------------------------*/
+
+    // Adds up the lane-iterations, interior pixels, periodic orbits, filled pixels and perturbation counters of every process
+    long long stats[11] = {escapeTotals.slots, escapeTotals.active, escapeTotals.interior, escapeTotals.cycles, subdivideFilled, perturbReferences, perturbGlitched, perturbSkipped, progressiveFilled, antialiasPixels, antialiasSamples}, allStats[11];
+
+    MPI_Reduce(stats, allStats, 11, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    if (rank == 0)
+    {
+        escapeTotals.slots = allStats[0];
+        escapeTotals.active = allStats[1];
+        escapeTotals.interior = allStats[2];
+        escapeTotals.cycles = allStats[3];
+        subdivideFilled = allStats[4];
+        perturbReferences = allStats[5];
+        perturbGlitched = allStats[6];
+        perturbSkipped = allStats[7];
+        progressiveFilled = allStats[8];
+        antialiasPixels = allStats[9];
+        antialiasSamples = allStats[10];
+
+        // Calculates and prints execution data
+        getResults(begin, end, end2, size);
     }
 
     // Terminates MPI execution environment
@@ -381,72 +784,776 @@ int main(int argc, char *argv[])
 
 /*---- Auxiliar Functions ---------------------------------------------------------------*/
 
-// Initializes the pixels array to avoid possible problems with left over values
-void fillPixels(struct rgb *pixels)
+// Calculates the rows initialPos..finalPos-1 of the image (of a frame of the animation) into pixels, with the engine selected by MANDELBROT_ENGINE
+// Called from a parallel region, the rows of the pixel engine are shared with the other threads as OpenMP tasks, the other engines run on the calling thread
+void calculateRows(unsigned char *pixels, int frame, int initialPos, int finalPos)
 {
-    // creating and initializing a black pixel variable
-    struct rgb pixel;
-    pixel.red = 0;
-    pixel.green = 0;
-    pixel.blue = 0;
-
-    // used to iterate over the pixels array
-    int p;
+    // image size, zoom and position used by the kernel
+    struct view view = {w, h, zoom, moveX, moveY};
 
-    for (p = 0; p < imageSize; p++)
+    // the zoom and position of the frame, in an animation
+    if (animationFrames > 0)
     {
-        pixels[p] = pixel;
+        animationView(frame, &view);
     }
-}
-
-// Joins the calculated Chunk of pixels to the complete Pixels array
-void joinPixels(struct rgb *pixels, struct rgb *tempPixels, int initialPos, int finalPos)
-{
-    // calculating initial and final position of the received fragment
-    initialPos = initialPos * w;
-    finalPos = finalPos * w;
 
-    // position in the final image array
-    int p;
-
-    //position in the received fragment array
-    int pos = 0;
+    // variable used to iterate over the rows
+    int y;
 
-    for (p = initialPos; p < finalPos; p++, pos++)
+    if (finalPos <= initialPos)
     {
-        pixels[p] = tempPixels[pos];
+        return;
     }
-}
-
-// Iterates through the calculated pixels sending them to be printed to the output image
-void printPixels(struct rgb *pixels)
-{
-    // variables used to iterate over the pixels array
-    int py, px;
 
-    // sends colors of each pixel to be printed in the output image
-    for (py = 0; py < h; py++)
+    // Mariani-Silver engine, the rows are subdivided by OpenMP tasks, progressive engine, the rows are refined
+    // from a coarse grid, or perturbation engine, the rows are iterated against the reference orbit
+    if (subdivideSelected() || perturbSelected() || progressiveSelected())
     {
-        for (px = 0; px < w; px++)
+        // escape iteration and final |z|^2 of each pixel of the rows
+        int *iterations = malloc(sizeof(int) * (finalPos - initialPos) * w);
+        double *norms = malloc(sizeof(double) * (finalPos - initialPos) * w);
+
+        if (perturbSelected())
+            perturbRender(&view, initialPos, finalPos, maxIterations, iterations, norms);
+        else if (progressiveSelected())
+            progressiveRender(&view, initialPos, finalPos, maxIterations, iterations, norms);
+        else
+            subdivideRender(&view, initialPos, finalPos, maxIterations, iterations, norms);
+
+        #pragma omp parallel for schedule(static) if (!omp_in_parallel())
+        for (y = initialPos; y < finalPos; y++)
         {
-            color((pixels[py * w + px]).red, (pixels[py * w + px]).green, (pixels[py * w + px]).blue);
+            storePixels(pixels + (size_t)(y - initialPos) * w * pixelSize, iterations + (y - initialPos) * w, norms + (y - initialPos) * w, w);
         }
-    }
-}
 
-// Prints the received RGB colors to the output image
-void color(int red, int green, int blue)
-{
-    fputc((char)red, stdout);
-    fputc((char)green, stdout);
-    fputc((char)blue, stdout);
-}
+        free(iterations);
+        free(norms);
 
-// Calculates and prints execution time results and parameters
-void getResults(double begin, double end, double end2, int size)
-{
-    // calculates time spent without printing
-    double time_spent = (end - begin);
+        // MANDELBROT_AA: the edges of the rows take more samples
+        if (antialias)
+        {
+            antialiasRect(&view, 0, initialPos, w, finalPos - initialPos, maxIterations, pixels, w);
+        }
+
+        return;
+    }
+
+    // Called from the team of the master, the rows are shared with the other threads as tasks
+    if (omp_in_parallel())
+    {
+        calculateBand(&view, pixels, w, 0, initialPos, w, initialPos, finalPos);
+    }
+
+    // Beginning of the OMP parallel section
+    else
+    {
+        #pragma omp parallel shared(view, pixels, initialPos) private(y)
+        {
+            // coordinates, escape iteration and final |z|^2 of each pixel of the current row
+            struct escapeWork work;
+            escapeWorkInit(&work, w);
+
+            // Determining the scheduling type of the loop - dynamic
+            // OpenMP divides the iterations into chunks of default size
+            #pragma omp for schedule(dynamic)
+
+            //loop through every row, the kernel iterates several pixels of the row at once
+            for (y = initialPos; y < finalPos; y++)
+            {
+                precisionRow(&view, y, 0, w, maxIterations, &work);
+
+                storePixels(pixels + (size_t)(y - initialPos) * w * pixelSize, work.iterations, work.norms, w);
+            }
+
+            escapeWorkFree(&work);
+        }
+    }
+    // End of the OMP parallel section
+
+    // MANDELBROT_AA: the edges of the rows take more samples
+    if (antialias)
+    {
+        antialiasRect(&view, 0, initialPos, w, finalPos - initialPos, maxIterations, pixels, w);
+    }
+}
+
+// Calculates the tw x th tile at (x0, y0) into pixels, whose rows are stride pixels apart
+// Called from a parallel region, the rows of the tile are shared with the other threads as OpenMP tasks
+void calculateTile(unsigned char *pixels, int stride, int x0, int y0, int tw, int th)
+{
+    // image size, zoom and position used by the kernel
+    struct view view = {w, h, zoom, moveX, moveY};
+
+    // variable used to iterate over the rows
+    int y;
+
+    // Called from the team of the master, the rows are shared with the other threads as tasks
+    if (omp_in_parallel())
+    {
+        calculateBand(&view, pixels, stride, x0, y0, tw, y0, y0 + th);
+    }
+
+    else
+    {
+        #pragma omp parallel shared(view, pixels) private(y)
+        {
+            // coordinates, escape iteration and final |z|^2 of each pixel of the current row of the tile
+            struct escapeWork work;
+            escapeWorkInit(&work, tw);
+
+            #pragma omp for schedule(dynamic)
+            for (y = y0; y < y0 + th; y++)
+            {
+                precisionRow(&view, y, x0, tw, maxIterations, &work);
+
+                storePixels(pixels + (size_t)(y - y0) * stride * pixelSize, work.iterations, work.norms, tw);
+            }
+
+            escapeWorkFree(&work);
+        }
+    }
+
+    // MANDELBROT_AA: the edges of the tile take more samples
+    if (antialias)
+    {
+        antialiasRect(&view, x0, y0, tw, th, maxIterations, pixels, stride);
+    }
+}
+
+// Calculates the rows first..last-1 of the tw pixels wide rectangle at (x0, y0) of the view into pixels, whose rows are stride pixels apart
+// From the team of the master the rows are split into OpenMP tasks of MASTER_TASK_ROWS rows: a thread waiting for its
+// fragment calculates tasks of any fragment, and the threads out of fragments take them at the end of the parallel region
+void calculateBand(const struct view *view, unsigned char *pixels, int stride, int x0, int y0, int tw, int first, int last)
+{
+    // first row of each task
+    int row;
+
+    for (row = first; row < last; row += MASTER_TASK_ROWS)
+    {
+        #pragma omp task firstprivate(row)
+        {
+            // coordinates, escape iteration and final |z|^2 of each pixel of the current row
+            struct escapeWork work;
+            int y, end = (row + MASTER_TASK_ROWS < last) ? row + MASTER_TASK_ROWS : last;
+
+            escapeWorkInit(&work, tw);
+
+            for (y = row; y < end; y++)
+            {
+                precisionRow(view, y, x0, tw, maxIterations, &work);
+
+                storePixels(pixels + (size_t)(y - y0) * stride * pixelSize, work.iterations, work.norms, tw);
+            }
+
+            escapeWorkFree(&work);
+        }
+    }
+
+    // the fragment is complete before it is smoothed, sent or written
+    #pragma omp taskwait
+}
+
+// Calculates a fragment, a tile or a band of rows, straight into its place in the image,
+// or apart when it is streamed to the output or kept for the MPI-IO write
+// Called from a parallel region, the rows of the fragment are shared with the other threads as OpenMP tasks
+void calculateFragment(unsigned char *pixels, int fragment)
+{
+    // position and size of the fragment, a tile or whole rows
+    int x0 = 0, y0 = fragmentRow(fragment), tw = w, th = fragmentRow(fragment + 1) - y0;
+
+    if (tilesSelected())
+    {
+        tileRect(fragment, w, h, &x0, &y0, &tw, &th);
+    }
+
+    // MPI-IO, the fragment is calculated apart and kept until the file is written
+    if (mpiio)
+    {
+        unsigned char *local = malloc(pixelSize * tw * th);
+
+        if (tilesSelected())
+        {
+            calculateTile(local, tw, x0, y0, tw, th);
+        }
+
+        else
+        {
+            calculateRows(local, 0, y0, y0 + th);
+        }
+
+        mpiioAddRect(local, pixelSize, x0, y0, tw, th, w);
+    }
+
+    // Streaming, the fragment is calculated apart and written to its place in the output
+    else if (streaming)
+    {
+        unsigned char *local = malloc(pixelSize * tw * th);
+
+        if (tilesSelected())
+        {
+            calculateTile(local, tw, x0, y0, tw, th);
+        }
+
+        else
+        {
+            calculateRows(local, 0, y0, y0 + th);
+        }
+
+        outputStreamRect(((size_t)y0 * w + x0) * pixelSize, local, tw * pixelSize, th, w * pixelSize);
+
+        free(local);
+    }
+
+    else if (tilesSelected())
+    {
+        calculateTile(pixels + ((size_t)y0 * w + x0) * pixelSize, w, x0, y0, tw, th);
+    }
+
+    else
+    {
+        calculateRows(pixels + (size_t)y0 * w * pixelSize, 0, y0, y0 + th);
+    }
+}
+
+// Receives the fragment whose message was probed into its place in the image, the tag of the message is the fragment
+void receiveFragment(unsigned char *pixels, MPI_Datatype MPI_PIXEL, MPI_Status *status)
+{
+    // From which process this message comes from, and the fragment number
+    int source = status->MPI_SOURCE, tag = status->MPI_TAG;
+
+    // MPI-IO, the worker kept the pixels of the fragment and only says it is done
+    if (mpiio)
+    {
+        MPI_Recv(NULL, 0, MPI_PIXEL, source, tag, MPI_COMM_WORLD, status);
+    }
+
+    // Streaming, the fragment is received apart and written to its place in the output
+    else if (streaming)
+    {
+        // Position and size of the fragment, a tile or whole rows
+        int x0 = 0, y0 = fragmentRow(tag), tw = w, th = fragmentRow(tag + 1) - y0;
+
+        if (tilesSelected())
+        {
+            tileRect(tag, w, h, &x0, &y0, &tw, &th);
+        }
+
+        MPI_Recv(streamBuffer, tw * th, MPI_PIXEL, source, tag, MPI_COMM_WORLD, status);
+
+        outputStreamRect(((size_t)y0 * w + x0) * pixelSize, streamBuffer, tw * pixelSize, th, w * pixelSize);
+    }
+
+    else if (tilesSelected())
+    {
+        // Position and size of that tile
+        int x0, y0, tw, th;
+
+        tileRect(tag, w, h, &x0, &y0, &tw, &th);
+
+        // Receiving calculated tile straight into its place in the rows of the final image
+        MPI_Recv(pixels + ((size_t)y0 * w + x0) * pixelSize, 1, tileTypes[tw < tileSide][th < tileSide], source, tag, MPI_COMM_WORLD, status);
+    }
+
+    else
+    {
+        // Calculating the initial position of that fragment
+        int initialPos = fragmentRow(tag);
+
+        // Calculating the final position of that fragment
+        int finalPos = fragmentRow(tag + 1);
+
+        // Receiving calculated fragment of mandelbtrot straight into its rows of the final image
+        MPI_Recv(pixels + (size_t)initialPos * w * pixelSize, (finalPos - initialPos) * w, MPI_PIXEL, source, tag, MPI_COMM_WORLD, status);
+    }
+}
+
+// Calculates fragments claimed from the window on the threads of the master and receives those of the workers
+// With MPI_THREAD_MULTIPLE and several threads, thread 0 only receives, like the scheduler of the master, while the
+// other threads claim and calculate; the last of them to run out of fragments tells thread 0 that its count of the
+// workers' fragments is final. Otherwise thread 0 alone receives the results that arrived between its own fragments
+void claimFragments(unsigned char *pixels, MPI_Datatype MPI_PIXEL, int provided)
+{
+    // Fragments of the workers received so far
+    int received = 0;
+
+    // Threads of the master that ran out of fragments to claim
+    int finished = 0;
+
+    #pragma omp parallel if (provided >= MPI_THREAD_MULTIPLE)
+    {
+        MPI_Status status;
+        int found;
+
+        // Whether thread 0 is kept for receiving
+        int receiver = (omp_get_num_threads() > 1);
+
+        if (!receiver || omp_get_thread_num() != 0)
+        {
+            while (1)
+            {
+                // Number of the fragment calculated by this thread
+                int pos;
+
+                // Alone, receives the fragments that already arrived, so the workers' sends complete early
+                if (!receiver)
+                {
+                    MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &found, &status);
+
+                    while (found)
+                    {
+                        receiveFragment(pixels, MPI_PIXEL, &status);
+                        received++;
+
+                        MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &found, &status);
+                    }
+                }
+
+                pos = claimFragment();
+
+                if (pos >= fragments)
+                {
+                    break;
+                }
+
+                #pragma omp atomic
+                masterClaimed++;
+
+                calculateFragment(pixels, pos);
+
+                #pragma omp atomic
+                masterFragments++;
+            }
+
+            // The last thread out of fragments sends thread 0 an empty message, tagged past the last fragment
+            if (receiver)
+            {
+                int last;
+
+                #pragma omp atomic capture
+                last = ++finished;
+
+                if (last == omp_get_num_threads() - 1)
+                {
+                    #pragma omp flush
+
+                    MPI_Send(NULL, 0, MPI_INT, 0, fragments, MPI_COMM_WORLD);
+                }
+            }
+        }
+
+        // Every fragment the master did not claim is calculated by a worker
+        if (omp_get_thread_num() == 0)
+        {
+            // Alone, thread 0 claimed the fragments of the master itself and the count is already final
+            int claimed = !receiver;
+
+            while (!claimed || received < fragments - masterClaimed)
+            {
+                MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+
+                if (status.MPI_SOURCE == 0 && status.MPI_TAG == fragments)
+                {
+                    MPI_Recv(NULL, 0, MPI_INT, 0, fragments, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+                    #pragma omp flush
+
+                    claimed = 1;
+                    continue;
+                }
+
+                receiveFragment(pixels, MPI_PIXEL, &status);
+                received++;
+            }
+        }
+    }
+}
+
+// Claims the next fragment from the window
+int claimFragment(void)
+{
+    int one = 1, claimed;
+
+    MPI_Fetch_and_op(&one, &claimed, MPI_INT, 0, 0, MPI_SUM, rmaWindow);
+    MPI_Win_flush(0, rmaWindow);
+
+    return claimed;
+}
+
+// Iterates the coarse grid of the progressive engine for the whole image and writes it as the preview
+// The fragments of the master start from the grid, the workers iterate the grid rows of their own fragments
+void progressivePass(void)
+{
+    // image size, zoom and position used by the kernel
+    struct view view = {w, h, zoom, moveX, moveY};
+
+    if (!progressiveSelected())
+    {
+        return;
+    }
+
+    progressiveCoarseInit(&view, maxIterations);
+
+    // MANDELBROT_PREVIEW: the grid is written as a low resolution image, long before the image is complete
+    if (getenv("MANDELBROT_PREVIEW") != NULL)
+    {
+        int columns = progressiveCoarseCount(w), rows = progressiveCoarseCount(h);
+        pixel_t *preview = malloc(sizeof(pixel_t) * columns * rows);
+
+        colorPixels(preview, progressiveCoarseIterations, progressiveCoarseNorms, columns * rows);
+        progressivePreview(getenv("MANDELBROT_PREVIEW"), (unsigned char *)preview, columns, rows);
+
+        free(preview);
+    }
+}
+
+// Converts the escape iteration and final |z|^2 of count pixels into their colors
+void colorPixels(pixel_t *pixels, const int *iterations, const double *norms, int count)
+{
+    // used to iterate over the pixels array
+    int p;
+
+    for (p = 0; p < count; p++)
+    {
+        // "i" will represent the number of iterations
+        int i = iterations[p];
+
+        // color(i % 256, 255, 255 * (i < maxIterations));
+        if (i == maxIterations)
+        {
+            //color(0, 0, 0); // black
+            pixels[p][0] = 0;
+            pixels[p][1] = 0;
+            pixels[p][2] = 0;
+        }
+
+        else
+        {
+            int brightness = escapeBrightness(i, norms[p], maxIterations);
+
+            //color(brightness, brightness, 255);
+            pixels[p][0] = brightness;
+            pixels[p][1] = brightness;
+            pixels[p][2] = 255;
+        }
+    }
+}
+
+// Stores count pixels as colors or, in raw mode, as the kernel left them
+void storePixels(unsigned char *pixels, const int *iterations, const double *norms, int count)
+{
+    if (raw)
+    {
+        rawPixels((struct rawPixel *)pixels, iterations, norms, count);
+    }
+
+    else
+    {
+        colorPixels((pixel_t *)pixels, iterations, norms, count);
+    }
+}
+
+// Initializes the pixels array to avoid possible problems with left over values
+void fillPixels(unsigned char *pixels)
+{
+    // every byte of a black pixel (or of a raw pixel) is 0
+    memset(pixels, 0, pixelSize * imageSize);
+}
+
+// First row of a fragment, the remainder rows are spread over the fragments
+int fragmentRow(int fragment)
+{
+    // fragments differ by at most one row and the last one ends at h
+    return (int)((long long)fragment * h / splits);
+}
+
+// Calculates the frames of the animation with the workers and the threads of the master, writing them in order
+// The fragments of every frame are numbered one after the other and handed out like the fragments of an image,
+// the frames being calculated are kept in a ring of FRAME_RING slots
+void animateFrames(MPI_Datatype MPI_PIXEL, int nworkers, int provided)
+{
+    // Fragments of every frame
+    int fragments = animationFrames * splits;
+
+    // Bytes of a frame
+    size_t frameSize = pixelSize * imageSize;
+
+    int worker, round, k;
+
+    frameRing = malloc(frameSize * FRAME_RING);
+
+    for (k = 0; k < FRAME_RING; k++)
+    {
+        frameRemaining[k] = splits;
+    }
+
+    workerQueue = malloc(sizeof(int) * (nworkers + 1) * FRAGMENT_WINDOW);
+    workerQueueFirst = calloc(nworkers + 1, sizeof(int));
+    workerQueueLength = calloc(nworkers + 1, sizeof(int));
+    workerParked = malloc(sizeof(int) * (nworkers + 1));
+    workerStopped = calloc(nworkers + 1, sizeof(int));
+
+    for (worker = 0; worker <= nworkers; worker++)
+    {
+        workerParked[worker] = -1;
+    }
+
+    // Header of the YUV4MPEG2 stream
+    animationStart(w, h);
+
+    // Sends the first FRAGMENT_WINDOW fragments to each worker
+    for (round = 0; round < FRAGMENT_WINDOW; round++)
+    {
+        for (worker = 1; worker <= nworkers; worker++)
+        {
+            if (!workerStopped[worker] && workerParked[worker] < 0)
+            {
+                giveFragment(worker, nextFragment++);
+            }
+        }
+    }
+
+    // Thread 0 serves the workers, the other threads calculate fragments from the same queue
+    #pragma omp parallel if (provided >= MPI_THREAD_FUNNELED)
+    {
+        if (omp_get_thread_num() == 0)
+        {
+            // Receives the calculated fragments until every assigned fragment came back and no worker waits for a slot
+            while (fragmentsOutstanding > 0 || workersParked > 0)
+            {
+                MPI_Status status;
+                int found = 1;
+
+                // Hands their fragment to the workers whose frame got a slot since
+                for (worker = 1; worker <= nworkers && workersParked > 0; worker++)
+                {
+                    int held = workerParked[worker];
+
+                    if (held >= 0 && frameFits(held))
+                    {
+                        workerParked[worker] = -1;
+                        workersParked--;
+                        giveFragment(worker, held);
+                    }
+                }
+
+                // While a worker waits for a slot, the frames being written are checked again between messages
+                if (workersParked > 0)
+                {
+                    MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &found, &status);
+
+                    if (!found)
+                    {
+                        sched_yield();
+                        continue;
+                    }
+                }
+
+                else
+                {
+                    MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+                }
+
+                int source = status.MPI_SOURCE;
+
+                // The messages of a worker arrive in the order it was given the fragments, which tells the frame
+                int *queue = workerQueue + source * FRAGMENT_WINDOW;
+                int fragment = queue[workerQueueFirst[source]];
+                int frame = fragment / splits;
+                int initialPos = fragmentRow(fragment % splits);
+                int finalPos = fragmentRow(fragment % splits + 1);
+
+                workerQueueFirst[source] = (workerQueueFirst[source] + 1) % FRAGMENT_WINDOW;
+                workerQueueLength[source]--;
+                fragmentsOutstanding--;
+
+                // Receiving the fragment straight into its rows of the frame
+                MPI_Recv(frameRing + (frame % FRAME_RING) * frameSize + (size_t)initialPos * w * pixelSize, (finalPos - initialPos) * w, MPI_PIXEL, source, status.MPI_TAG, MPI_COMM_WORLD, &status);
+
+                fragmentDone(frame);
+
+                // A worker which was told to stop or waits for a slot gets nothing else
+                if (workerStopped[source] || workerParked[source] >= 0)
+                {
+                    continue;
+                }
+
+                int next;
+
+                #pragma omp atomic capture
+                next = nextFragment++;
+
+                giveFragment(source, next);
+            }
+        }
+
+        // Calculates fragments until the queue is empty
+        while (1)
+        {
+            int fragment;
+
+            #pragma omp atomic capture
+            fragment = nextFragment++;
+
+            if (fragment >= fragments)
+            {
+                break;
+            }
+
+            // Waits until the slot of its frame is written and freed
+            while (!frameFits(fragment))
+            {
+                sched_yield();
+            }
+
+            int frame = fragment / splits;
+            int initialPos = fragmentRow(fragment % splits);
+            int finalPos = fragmentRow(fragment % splits + 1);
+
+            calculateRows(frameRing + (frame % FRAME_RING) * frameSize + (size_t)initialPos * w * pixelSize, frame, initialPos, finalPos);
+
+            fragmentDone(frame);
+
+            #pragma omp atomic
+            masterFragments++;
+        }
+    }
+
+    free(workerQueue);
+    free(workerQueueFirst);
+    free(workerQueueLength);
+    free(workerParked);
+    free(workerStopped);
+    free(frameRing);
+}
+
+// Whether the frame of a fragment of the animation has a slot in the ring
+int frameFits(int fragment)
+{
+    int written;
+
+    #pragma omp atomic read seq_cst
+    written = framesWritten;
+
+    return fragment / splits < written + FRAME_RING;
+}
+
+// Assigns a fragment of the animation to a worker, holds it back if its frame has no slot, or stops the worker
+// Called by thread 0 of the master only
+void giveFragment(int worker, int fragment)
+{
+    if (fragment >= animationFrames * splits)
+    {
+        int stop = -1;
+
+        workerStopped[worker] = 1;
+        MPI_Send(&stop, 1, MPI_INT, worker, 0, MPI_COMM_WORLD);
+        return;
+    }
+
+    if (!frameFits(fragment))
+    {
+        workerParked[worker] = fragment;
+        workersParked++;
+        return;
+    }
+
+    int *queue = workerQueue + worker * FRAGMENT_WINDOW;
+
+    queue[(workerQueueFirst[worker] + workerQueueLength[worker]) % FRAGMENT_WINDOW] = fragment;
+    workerQueueLength[worker]++;
+    fragmentsOutstanding++;
+
+    MPI_Send(&fragment, 1, MPI_INT, worker, 0, MPI_COMM_WORLD);
+}
+
+// Counts a calculated fragment of a frame of the animation, writing the frames that are complete
+void fragmentDone(int frame)
+{
+    int left;
+
+    #pragma omp atomic capture seq_cst
+    left = --frameRemaining[frame % FRAME_RING];
+
+    if (left == 0)
+    {
+        writeFrames();
+    }
+}
+
+// Writes the complete frames following the ones already written, in order
+// A frame completed before the previous ones is written by the thread completing the oldest one
+void writeFrames(void)
+{
+    // PPM (or raw) header of every frame
+    char header[256];
+
+    if (raw)
+    {
+        rawHeader(header, sizeof(header), w, h, maxIterations);
+    }
+
+    else
+    {
+        snprintf(header, sizeof(header), "P6\n# Original Code CREATOR: Eric R. Weeks / mandel program - Changes by: Daniel V. Cordeiro & Rafael C. Pereira\n%d %d\n255\n", w, h);
+    }
+
+    #pragma omp critical (animationWrite)
+    {
+        while (framesWritten < animationFrames)
+        {
+            int slot = framesWritten % FRAME_RING, left;
+
+            #pragma omp atomic read seq_cst
+            left = frameRemaining[slot];
+
+            if (left > 0)
+            {
+                break;
+            }
+
+            animationWrite(header, frameRing + slot * pixelSize * imageSize, pixelSize * imageSize, w, h);
+
+            // The slot takes the frame FRAME_RING frames later
+            #pragma omp atomic write seq_cst
+            frameRemaining[slot] = splits;
+
+            #pragma omp atomic update seq_cst
+            framesWritten++;
+        }
+    }
+}
+
+// Writes the calculated pixels, after the header, to the output image or the raw file
+void printPixels(unsigned char *pixels)
+{
+    // PPM (or raw) header of the output image
+    char header[256];
+
+    imageHeader(header, sizeof(header));
+
+    // the pixels already are R, G, B bytes (or raw records) in image order, they are written as they are
+    outputImage(header, pixels, pixelSize * imageSize);
+}
+
+// Formats the PPM (or raw) header of the output image
+void imageHeader(char *header, size_t size)
+{
+    if (raw)
+    {
+        rawHeader(header, size, w, h, maxIterations);
+    }
+
+    else
+    {
+        snprintf(header, size, "P6\n# Original Code CREATOR: Eric R. Weeks / mandel program - Changes by: Daniel V. Cordeiro & Rafael C. Pereira\n%d %d\n255\n", w, h);
+    }
+}
+
+// Calculates and prints execution time results and parameters
+void getResults(double begin, double end, double end2, int size)
+{
+    // calculates time spent without printing
+    double time_spent = (end - begin);
 
     // calculates time spent with printing
     double time_spent2 = (end2 - begin);
@@ -454,9 +1561,55 @@ void getResults(double begin, double end, double end2, int size)
     // prints Execution Details
     fprintf(stderr, "W: %d, H: %d, Iterations: %d Processes:%i Threads: %i Splits: %i\n", w, h, maxIterations, size, numThreads, splits);
 
+    // prints how many fragments the threads of the master calculated themselves
+    fprintf(stderr, "Fragments calculated by the master: %d of %d (%s scheduler)\n", masterFragments, animationFrames > 0 ? splits * animationFrames : fragments, schedulerName);
+
+    // prints the tiles the image was cut into
+    if (tilesSelected())
+        fprintf(stderr, "Tiles: %d of %dx%d pixels, %s order.\n", tileCount, tileSide, tileSide, tileOrderName);
+
+    // prints the frames of the animation
+    if (animationFrames > 0)
+        fprintf(stderr, "Animation: %d frames written (%s).\n", framesWritten, raw ? "raw" : animationY4m ? "y4m" : "ppm");
+
+    // prints the kernel used by the master node and how busy the vector lanes of all processes were
+    fprintf(stderr, "Kernel: %s (%s), lane utilisation: %.2lf%%\n", escapeIsa, escapeMode, escapeUtilisation(&escapeTotals));
+
+    // prints the precision the pixels were iterated in, chosen from the pixel spacing and, for float, a sample of the view
+    if (!subdivideSelected() && !perturbSelected() && !progressiveSelected())
+        fprintf(stderr, "Precision: %s (pixel spacing %.3g).\n", precisionName, precisionSpacing);
+
+    if (!subdivideSelected() && !perturbSelected() && !progressiveSelected() && precisionMismatches >= 0)
+        fprintf(stderr, "Float sample: %d of %d pixels off the double reference, %d across maxIterations.\n", precisionMismatches, precisionSamples, precisionCrossed);
+
+    // prints how many pixels the interior pre-check painted without iterating
+    fprintf(stderr, "Interior pre-check: %lld pixels skipped.\n", escapeTotals.interior);
+
+    // prints how many orbits the periodicity check stopped before maxIterations
+    fprintf(stderr, "Periodicity check: %lld orbits converged.\n", escapeTotals.cycles);
+
+    // prints how many pixels the subdivision engine filled without iterating
+    if (subdivideSelected())
+        fprintf(stderr, "Subdivision: %lld pixels filled.\n", subdivideFilled);
+
+    // prints how many pixels the progressive engine interpolated without iterating, in all processes
+    if (progressiveSelected())
+        fprintf(stderr, "Progressive: %lld pixels interpolated (%s).\n", progressiveFilled, progressiveExact() ? "exact" : "interpolate");
+
+    // prints how many edge pixels took more samples, in all processes, and how many samples that took
+    if (antialias)
+        fprintf(stderr, "Anti-aliasing: %lld edge pixels, %lld sub-samples (%.2lf per pixel of the image, budget %d).\n", antialiasPixels, antialiasSamples, (double)antialiasSamples / imageSize / (animationFrames > 0 ? animationFrames : 1), antialiasBudget());
+
+    // prints the reference orbits of all processes, glitches and iterations skipped by the perturbation engine
+    if (perturbSelected())
+        fprintf(stderr, "Perturbation: %lld reference orbits (%.4lf seconds for the first), %lld pixels glitched, %lld iterations skipped.\n", perturbReferences, perturbSeconds, perturbGlitched, perturbSkipped);
+
     // prints Elapsed times without printing
     fprintf(stderr, "\nElapsed time: %.4lf seconds.\n", time_spent);
 
     // prints Elapsed times with printing
     fprintf(stderr, "\nElapsed time with printing: %.4lf seconds.\n", time_spent2);
+
+    // prints how fast the image was written
+    fprintf(stderr, "\nOutput: %.1lf MB in %.4lf seconds (%s, %.1lf MB/s).\n", outputBytes / 1e6, outputSeconds, outputMethod, outputThroughput());
 }
@@ -1,6 +1,7 @@
 #!/bin/bash
 
-mpicc mandelbrot-hybrid-static.c -fopenmp -lm -o mandelbrot-hybrid-static
+# builds the program in the folder above, which includes ../../Common
+mpicc -O2 -fopenmp ../mandelbrot-hybrid-static.c -o mandelbrot-hybrid-static -lm
 
 cat names.txt | while read line 
 do
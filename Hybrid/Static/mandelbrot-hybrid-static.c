@@ -16,11 +16,24 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
 #include <time.h>
 #include <stdio.h>
 #include <omp.h>
 #include <mpi.h>
 
+#include "../../Common/mandelbrot-kernel.h"
+#include "../../Common/mandelbrot-subdivide.h"
+#include "../../Common/mandelbrot-progressive.h"
+#include "../../Common/mandelbrot-antialias.h"
+#include "../../Common/mandelbrot-perturbation.h"
+#include "../../Common/mandelbrot-precision.h"
+#include "../../Common/mandelbrot-output.h"
+#include "../../Common/mandelbrot-mpiio.h"
+#include "../../Common/mandelbrot-raw.h"
+#include "../../Common/mandelbrot-balance.h"
+
 /*---- Declarations -------------------------------------------------------------------------
 *   Height h, Width d, and Number of Iterations maxIterations
 *   vary according with pre-determined combinations
@@ -52,29 +65,50 @@ int maxIterations = 10000;
 // Used to indicate the number of threads used on the execution of the code
 int numThreads = 0;
 
-// Structure with 3 values, corresponding to Red, Green, and Blue
-struct rgb
-{
-    int red, green, blue;
-};
+// Zoom and position of the view
+double zoom = 1, moveX = -0.5, moveY = 0;
+
+// Pixel with 3 bytes, corresponding to Red, Green, and Blue
+typedef unsigned char pixel_t[3];
+
+// Whether the escape iterations and final |z|^2 are sent and written instead of the colors
+int raw = 0;
+
+// Whether the edges of the image are anti-aliased, MANDELBROT_AA without raw output or the perturbation engine
+int antialias = 0;
+
+// Size in bytes of a pixel, pixel_t or struct rawPixel in raw mode
+size_t pixelSize = sizeof(pixel_t);
 
 /*---- Declaring Functions ---------------------------------------------------------------*/
 
 // Initializes the pixels array to avoid possible problems with left over values
-void fillPixels(struct rgb *pixels);
+void fillPixels(unsigned char *pixels);
+
+// First row of a band when the image is cut into bands, the remainder rows are spread over the bands
+int bandRow(int band, int bands);
+
+// Writes the calculated pixels, after the header, to the output image or the raw file
+void printPixels(unsigned char *pixels);
 
-// Joins the calculated Chunk of pixels to the complete Pixels array
-void joinPixels(struct rgb *pixels, struct rgb *tempPixels, int initialPos, int finalPos);
+// Formats the PPM (or raw) header of the output image
+void imageHeader(char *header, size_t size);
 
-// Iterates through the calculated pixels sending them to be printed to the output image
-void printPixels(struct rgb *pixels);
+// Calculates the rows initialPos..finalPos-1 of the image into pixels, with the engine selected by MANDELBROT_ENGINE
+void calculateRows(unsigned char *pixels, int initialPos, int finalPos);
 
-// Prints the received RGB colors to the output image
-void color(int red, int green, int blue);
+// Converts the escape iteration and final |z|^2 of count pixels into their colors
+void colorPixels(pixel_t *pixels, const int *iterations, const double *norms, int count);
+
+// Stores count pixels as colors or, in raw mode, as the kernel left them
+void storePixels(unsigned char *pixels, const int *iterations, const double *norms, int count);
 
 // Calculates and prints execution time results and parameters
 void getResults(double begin, double end, double end2, int size);
 
+// Prints the rows of every band, the share of the work the cost model predicted for it and the time it took
+void printBands(const int *bandFirst, const double *bandCost, const double *bandTimes, int size, double previewTime);
+
 
 /*---- MAIN ---------------------------------------------------------------*/
 
@@ -100,20 +134,14 @@ int main(int argc, char *argv[])
 
     /*---- Variables ---------------------------------------------------------------*/
 
-    // Allocating space for all the pixels
-    struct rgb *pixels = malloc(sizeof(struct rgb) * imageSize);
-
     // Variables used to calculate execution time
-    double begin, end, end2;
+    double begin = 0, end = 0, end2 = 0;
 
     // Variables used by MPI
     int rank, size;
 
-    // Variables used on the master-worker process
-    int nworkers, aux;
-
-    // Value that represents the status of the received message.
-    MPI_Status status;
+    // Variable used to iterate over the processes
+    int aux;
 
 
     /*---- MPI --------------------------------------------------------*/
@@ -131,88 +159,175 @@ int main(int argc, char *argv[])
     // Get number of processes
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-    // Defining the number of Workers
-    nworkers = size - 1;
+    // Selects the widest SIMD kernel supported by the node running this process
+    escapeInit();
 
-    // Determining the number of lines to bee calculated in each fragment
-    int fragmentHeight = h / nworkers;
+    // MANDELBROT_ZOOM, MANDELBROT_CENTER_RE and MANDELBROT_CENTER_IM move the view, the perturbation engine
+    // computes the reference orbit of its center in every process, and the precision of the kernels is chosen for it
+    struct view view = {w, h, zoom, moveX, moveY};
 
-    /*---- Creating MPI_RGB struct ------------------------------------------------------------------------------*/
+    viewInit(&view);
+    perturbInit(&view, maxIterations);
+    precisionInit(&view, maxIterations);
 
-    MPI_Datatype MPI_RGB;    
+    zoom = view.zoom;
+    moveX = view.moveX;
+    moveY = view.moveY;
 
-    MPI_Datatype type[3] = {MPI_INT, MPI_INT, MPI_INT};
-    
-    MPI_Type_commit(type);
-    
-    int blocklen[3] = {1, 1, 1};
+    /*---- Creating MPI_PIXEL type ------------------------------------------------------------------------------*/
 
-    MPI_Aint displacement[3] = {0, sizeof(int), sizeof(int) * 2};
+    // Selects the raw output, in which the workers send the escape iterations and final |z|^2 instead of the colors
+    raw = rawSelected();
 
-    MPI_Type_create_struct(3, blocklen, displacement, type, &MPI_RGB);
-    
-    MPI_Type_commit(&MPI_RGB);
+    // The sub-samples are colored and iterated in double precision, which the raw output and deep zooms cannot use
+    antialias = antialiasSelected() && !raw && !perturbSelected();
 
-    
+    pixelSize = raw ? sizeof(struct rawPixel) : sizeof(pixel_t);
 
-    /*---- Executing ------------------------------------------------------------------------------*/
+    // A pixel travels with the same layout it has in memory: its 3 bytes, or a struct rawPixel
+    MPI_Datatype MPI_PIXEL;
 
+    if (raw)
+    {
+        MPI_Datatype type[2] = {MPI_UINT32_T, MPI_FLOAT};
 
-    /*---- Master --------*/
-    if (rank == 0)
+        int blocklen[2] = {1, 1};
+
+        MPI_Aint displacement[2] = {offsetof(struct rawPixel, iteration), offsetof(struct rawPixel, norm)};
+
+        MPI_Type_create_struct(2, blocklen, displacement, type, &MPI_PIXEL);
+    }
+
+    else
     {
+        MPI_Type_contiguous(3, MPI_UNSIGNED_CHAR, &MPI_PIXEL);
+    }
 
-        // Initializing  final image pixels array 
-        fillPixels(pixels);
+    MPI_Type_commit(&MPI_PIXEL);
 
-        // start counting execution time
-        begin = MPI_Wtime();
-        
-        /*---- Printing Execution Details --------------------------------------------------------*/
 
-        printf("P6\n# Original Code CREATOR: Eric R. Weeks / mandel program - Changes by: Daniel V. Cordeiro & Rafael C. Pereira\n");
-        printf("%d %d\n255\n",w, h);
-        
+    /*---- Bands ------------------------------------------------------------------------------*/
 
-        /*---- Managing MPI Message Exchange and Image Calculation --------------------------------------------------------*/
+    // start counting execution time, the preview of the cost model is part of it
+    begin = MPI_Wtime();
 
-        // Receives the messages (fragments) have already been calculated by each worker process
-        for (aux = 1; aux < size; aux++)
-        {
-            // Calculating the initial and final positions of that fragment
-            int initialPos = (aux-1) * fragmentHeight;
-            int finalPos = h / (nworkers) * aux;
+    // Every process, the master included, calculates one band of rows
+    // first row of every band, and the cost the model predicts for it (0 with bands of equal rows)
+    int *bandFirst = malloc(sizeof(int) * (size + 1));
+    double *bandCost = calloc(size, sizeof(double));
 
-            // Caculating fragment (chunk) size
-            int chunkSize = h - initialPos;
+    // seconds spent on the preview
+    double previewTime = 0;
 
-            // Allocating space for current chunk of pixels
-            struct rgb *rcvdPixels = malloc(sizeof(struct rgb) * chunkSize * w);
+    if (balanceSelected())
+    {
+        // cost of the stripe of each preview row, every process iterates a share of the rows and they are added up
+        int previewRows = balancePreviewRows(h);
+        double *cost = calloc(previewRows, sizeof(double));
+
+        balancePreview(&view, maxIterations, rank, size, cost);
+
+        MPI_Allreduce(MPI_IN_PLACE, cost, previewRows, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
 
-            // Receiving calculated fragment of mandelbtrot
-            MPI_Recv(rcvdPixels, chunkSize * w, MPI_RGB, aux, MPI_ANY_TAG, MPI_COMM_WORLD, &status);            
+        // every process cuts the same bands from the same costs
+        balanceBands(cost, previewRows, h, size, bandFirst, bandCost);
 
-            // Joins the received fragment with the final complete image
-            joinPixels(pixels, rcvdPixels, initialPos, finalPos);           
+        free(cost);
+
+        previewTime = MPI_Wtime() - begin;
+    }
 
-            // Deallocates the memory previously allocated
-            free(rcvdPixels);
+    else
+    {
+        for (aux = 0; aux <= size; aux++)
+        {
+            bandFirst[aux] = bandRow(aux, size);
         }
+    }
 
-        // Stops counting execution time 
+    // counts and displacements of the bands in the final image, in pixels
+    int *counts = malloc(sizeof(int) * size);
+    int *displs = malloc(sizeof(int) * size);
+
+    for (aux = 0; aux < size; aux++)
+    {
+        displs[aux] = bandFirst[aux] * w;
+        counts[aux] = (bandFirst[aux + 1] - bandFirst[aux]) * w;
+    }
+
+    // initial and final position of the band of this process
+    int initialPos = bandFirst[rank];
+    int finalPos = bandFirst[rank + 1];
+
+    // seconds this process spent calculating its band, and those of every process on the master
+    double bandTime = 0;
+    double *bandTimes = malloc(sizeof(double) * size);
+
+
+    /*---- Executing ------------------------------------------------------------------------------*/
+
+    if (rank == 0 && !mpiioSelected() && getenv("MANDELBROT_WRITER") != NULL && strcmp(getenv("MANDELBROT_WRITER"), "mpiio") == 0)
+    {
+        fprintf(stderr, "MANDELBROT_WRITER=mpiio needs MANDELBROT_FILE, the image is written to stdout by the master\n");
+    }
+
+    /*---- MPI-IO --------*/
+
+    // MANDELBROT_WRITER=mpiio: every process, the master included, writes its own band to MANDELBROT_FILE
+    if (mpiioSelected())
+    {
+        // Allocating space for the pixels of the band, kept until the file is written
+        unsigned char *localPixels = malloc(pixelSize * counts[rank]);
+
+        // PPM (or raw) header of the output image
+        char header[256];
+
+        // Calculates the rows of the band
+        bandTime = MPI_Wtime();
+        calculateRows(localPixels, initialPos, finalPos);
+        bandTime = MPI_Wtime() - bandTime;
+
+        mpiioAddRect(localPixels, pixelSize, 0, initialPos, w, finalPos - initialPos, w);
+
+        // Stops counting execution time once every band is calculated
+        MPI_Barrier(MPI_COMM_WORLD);
         end = MPI_Wtime();
 
-        // Print calculated image
-        printPixels(pixels);
+        imageHeader(header, sizeof(header));
+
+        // Every process writes its band at its offset in the file, rank 0 writes the header too
+        mpiioWrite(header, MPI_PIXEL, pixelSize, imageSize);
+        mpiioFree();
 
         // Stops counting execution time - taking into account printing time
         end2 = MPI_Wtime();
+    }
+
+    /*---- Master --------*/
+    else if (rank == 0)
+    {
+        // Allocating space for all the pixels, the master calculates its band in place
+        unsigned char *pixels = malloc(pixelSize * imageSize);
 
+        // Initializing  final image pixels array 
+        fillPixels(pixels);
 
-        /*---- Results ------------------------------------------------------------------------------*/
+        // Calculates the rows of the band of the master
+        bandTime = MPI_Wtime();
+        calculateRows(pixels + (size_t)displs[rank] * pixelSize, initialPos, finalPos);
+        bandTime = MPI_Wtime() - bandTime;
 
-        // Calculates and prints execution data
-        getResults(begin, end, end2 , size);
+        // Gathers the bands of the other processes behind the band of the master
+        MPI_Gatherv(MPI_IN_PLACE, counts[rank], MPI_PIXEL, pixels, counts, displs, MPI_PIXEL, 0, MPI_COMM_WORLD);
+
+        // Stops counting execution time 
+        end = MPI_Wtime();
+
+        // Print calculated image
+        printPixels(pixels);
+
+        // Stops counting execution time - taking into account printing time
+        end2 = MPI_Wtime();
 
         // Deallocates the memory previously allocated
         free(pixels);
@@ -220,104 +335,62 @@ int main(int argc, char *argv[])
 
     /*---- Worker --------*/
 
-    // Calculate the Mandelbrot fragment
+    // Calculate the Mandelbrot band
     else
     {
-        /*---- Variables ------------------------------------------------------------------------------*/
+        // Allocating space for the pixels of the band
+        unsigned char *localPixels = malloc(pixelSize * counts[rank]);
 
-        // variables used for iteration
-        int x, y;
+        // Calculates the rows of the band
+        bandTime = MPI_Wtime();
+        calculateRows(localPixels, initialPos, finalPos);
+        bandTime = MPI_Wtime() - bandTime;
 
-        // variable to hold 1 calculated pixel colors [R, G ,B]
-        struct rgb pixel;
+        // Sends the calculated band to the master process
+        MPI_Gatherv(localPixels, counts[rank], MPI_PIXEL, NULL, NULL, NULL, MPI_PIXEL, 0, MPI_COMM_WORLD);
 
-        // initial and final position of that fragment
-        int initialPos = (rank-1) * fragmentHeight;
-        int finalPos = h / (nworkers) * rank;
+        // Deallocates the memory previously allocated
+        free(localPixels);
+    }
 
-        // Caculating fragment (chunk) size
-        int chunkSize = h - initialPos;
+    free(counts);
+    free(displs);
 
-        // real and imaginary part of the pixel p
-        double pr, pi;
+    // Collects the time every process spent on its band
+    MPI_Gather(&bandTime, 1, MPI_DOUBLE, bandTimes, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
 
-        // real and imaginary parts of new and old z
-        double newRe, newIm, oldRe, oldIm;
+    /*---- Results ------------------------------------------------------------------------------*/
 
-        // zoom and position
-        double zoom = 1, moveX = -0.5, moveY = 0;
+    // Adds up the lane-iterations, interior pixels, periodic orbits, filled pixels and perturbation counters of every process
+    long long stats[11] = {escapeTotals.slots, escapeTotals.active, escapeTotals.interior, escapeTotals.cycles, subdivideFilled, perturbReferences, perturbGlitched, perturbSkipped, progressiveFilled, antialiasPixels, antialiasSamples}, allStats[11];
 
-        // Allocating space for the pixels in this rank
-        struct rgb *localPixels = malloc(sizeof(struct rgb) * chunkSize*w);
+    MPI_Reduce(stats, allStats, 11, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
 
-        // Beginning of the OMP parallel section
-        #pragma omp parallel shared(zoom, moveX, moveY, localPixels, initialPos) private(y, x, pr, pi, newRe, newIm, oldRe, oldIm, pixel)
-        {
-            // Determining the scheduling type of the loop - dynamic
-            // OpenMP divides the iterations into chunks of default size
-            #pragma omp for schedule(dynamic)
-            //loop through every pixel
-            for (y = initialPos; y < finalPos; y++)
-            {
-                for (x = 0; x < w; x++)
-                {
-                    // calculate the initial real and imaginary part of z, based on the pixel location and zoom and position values
-                    pr = 1.5 * (x - w / 2) / (0.5 * zoom * w) + moveX;
-                    pi = (y - h / 2) / (0.5 * zoom * h) + moveY;
-                    newRe = newIm = oldRe = oldIm = 0; //these should start at 0,0
-
-                    // "i" will represent the number of iterations
-                    int i;
-
-                    // start the iteration process
-                    for (i = 0; i < maxIterations; i++)
-                    {
-                        // remember value of previous iteration
-                        oldRe = newRe;
-                        oldIm = newIm;
-                        //the actual iteration, the real and imaginary part are calculated
-                        newRe = oldRe * oldRe - oldIm * oldIm + pr;
-                        newIm = 2 * oldRe * oldIm + pi;
-
-                        //if the point is outside the circle with radius 2: stop
-                        if ((newRe * newRe + newIm * newIm) > 4)
-                            break;
-                    }
-
-                    // Calculates position of the current calculated pixel
-                    int posLocal = (y - initialPos) * w + x;
-
-                    // color(i % 256, 255, 255 * (i < maxIterations));
-                    if (i == maxIterations)
-                    {
-                        //color(0, 0, 0); // black
-                        pixel.red = 0;
-                        pixel.green = 0;
-                        pixel.blue = 0;
-                    }
-
-                    else
-                    {
-                        double z = sqrt(newRe * newRe + newIm * newIm);
-                        int brightness = 256 * log2(1.75 + i - log2(log2(z))) / log2((double)maxIterations);
-
-                        //color(brightness, brightness, 255);
-                        pixel.red = brightness;
-                        pixel.green = brightness;
-                        pixel.blue = 255;
-                    }
-
-                    // Putting the calculated pixel in the fragment array
-                    localPixels[posLocal] = pixel;
-                }
-            }
-            // End of the OMP parallel section
-        }
+    if (rank == 0)
+    {
+        escapeTotals.slots = allStats[0];
+        escapeTotals.active = allStats[1];
+        escapeTotals.interior = allStats[2];
+        escapeTotals.cycles = allStats[3];
+        subdivideFilled = allStats[4];
+        perturbReferences = allStats[5];
+        perturbGlitched = allStats[6];
+        perturbSkipped = allStats[7];
+        progressiveFilled = allStats[8];
+        antialiasPixels = allStats[9];
+        antialiasSamples = allStats[10];
+
+        // Calculates and prints execution data
+        getResults(begin, end, end2, size);
 
-        // Sends back to the master process the calculated fragment
-        MPI_Send(localPixels, chunkSize * w, MPI_RGB, 0, rank, MPI_COMM_WORLD);        
+        // Prints the predicted and actual work of every band
+        printBands(bandFirst, bandCost, bandTimes, size, previewTime);
     }
 
+    free(bandFirst);
+    free(bandCost);
+    free(bandTimes);
+
     // Finalizes MPI
     MPI_Finalize();
 
@@ -327,65 +400,167 @@ int main(int argc, char *argv[])
 
 /*---- Generating Image Output ---------------------------------------------------------------*/
 
-// Initializes the pixels array to avoid possible problems with left over values
-void fillPixels(struct rgb *pixels)
+// Calculates the rows initialPos..finalPos-1 of the image into pixels, with the engine selected by MANDELBROT_ENGINE
+void calculateRows(unsigned char *pixels, int initialPos, int finalPos)
 {
-    // creating and initializing a black pixel variable
-    struct rgb pixel;
-    pixel.red = 0;
-    pixel.green = 0;
-    pixel.blue = 0;
+    // image size, zoom and position used by the kernel
+    struct view view = {w, h, zoom, moveX, moveY};
 
-    // used to iterate over the pixels array
-    int p;
+    // variable used to iterate over the rows
+    int y;
 
-    for (p = 0; p < imageSize; p++)
+    if (finalPos <= initialPos)
     {
-        pixels[p] = pixel;
+        return;
     }
-}
 
-// Joins the calculated Chunk of pixels to the complete Pixels array
-void joinPixels(struct rgb *pixels, struct rgb *tempPixels, int initialPos, int finalPos)
-{
-    // calculating initial and final position of the received fragment
-    initialPos = initialPos * w;
-    finalPos = finalPos * w;
+    // Mariani-Silver engine, the rows are subdivided by OpenMP tasks, progressive engine, the rows are refined
+    // from a coarse grid, or perturbation engine, the rows are iterated against the reference orbit
+    if (subdivideSelected() || perturbSelected() || progressiveSelected())
+    {
+        // escape iteration and final |z|^2 of each pixel of the rows
+        int *iterations = malloc(sizeof(int) * (finalPos - initialPos) * w);
+        double *norms = malloc(sizeof(double) * (finalPos - initialPos) * w);
+
+        if (perturbSelected())
+            perturbRender(&view, initialPos, finalPos, maxIterations, iterations, norms);
+        else if (progressiveSelected())
+            progressiveRender(&view, initialPos, finalPos, maxIterations, iterations, norms);
+        else
+            subdivideRender(&view, initialPos, finalPos, maxIterations, iterations, norms);
+
+        #pragma omp parallel for schedule(static)
+        for (y = initialPos; y < finalPos; y++)
+        {
+            storePixels(pixels + (size_t)(y - initialPos) * w * pixelSize, iterations + (y - initialPos) * w, norms + (y - initialPos) * w, w);
+        }
 
-    // position in the final image array
-    int p;
+        free(iterations);
+        free(norms);
+
+        // MANDELBROT_AA: the edges of the rows take more samples
+        if (antialias)
+        {
+            antialiasRect(&view, 0, initialPos, w, finalPos - initialPos, maxIterations, pixels, w);
+        }
+
+        return;
+    }
+
+    // Beginning of the OMP parallel section
+    #pragma omp parallel shared(view, pixels, initialPos) private(y)
+    {
+        // coordinates, escape iteration and final |z|^2 of each pixel of the current row
+        struct escapeWork work;
+        escapeWorkInit(&work, w);
+
+        // Determining the scheduling type of the loop - dynamic
+        // OpenMP divides the iterations into chunks of default size
+        #pragma omp for schedule(dynamic)
+
+        //loop through every row, the kernel iterates several pixels of the row at once
+        for (y = initialPos; y < finalPos; y++)
+        {
+            precisionRow(&view, y, 0, w, maxIterations, &work);
 
-    //position in the received fragment array
-    int pos = 0;
+            storePixels(pixels + (size_t)(y - initialPos) * w * pixelSize, work.iterations, work.norms, w);
+        }
+
+        escapeWorkFree(&work);
+    }
+    // End of the OMP parallel section
 
-    for (p = initialPos; p < finalPos; p++, pos++)
+    // MANDELBROT_AA: the edges of the rows take more samples
+    if (antialias)
     {
-        pixels[p] = tempPixels[pos];
+        antialiasRect(&view, 0, initialPos, w, finalPos - initialPos, maxIterations, pixels, w);
     }
 }
 
-// Iterates through the calculated pixels sending them to be printed to the output image
-void printPixels(struct rgb *pixels)
+// Converts the escape iteration and final |z|^2 of count pixels into their colors
+void colorPixels(pixel_t *pixels, const int *iterations, const double *norms, int count)
 {
-    // variables used to iterate over the pixels array
-    int py, px;
+    // used to iterate over the pixels array
+    int p;
 
-    // sends colors of each pixel to be printed in the output image
-    for (py = 0; py < h; py++)
+    for (p = 0; p < count; p++)
     {
-        for (px = 0; px < w; px++)
+        // "i" will represent the number of iterations
+        int i = iterations[p];
+
+        // color(i % 256, 255, 255 * (i < maxIterations));
+        if (i == maxIterations)
         {
-            color((pixels[py * w + px]).red, (pixels[py * w + px]).green, (pixels[py * w + px]).blue);
+            //color(0, 0, 0); // black
+            pixels[p][0] = 0;
+            pixels[p][1] = 0;
+            pixels[p][2] = 0;
+        }
+
+        else
+        {
+            int brightness = escapeBrightness(i, norms[p], maxIterations);
+
+            //color(brightness, brightness, 255);
+            pixels[p][0] = brightness;
+            pixels[p][1] = brightness;
+            pixels[p][2] = 255;
         }
     }
 }
 
-// Prints the received RGB colors to the output image
-void color(int red, int green, int blue)
+// Stores count pixels as colors or, in raw mode, as the kernel left them
+void storePixels(unsigned char *pixels, const int *iterations, const double *norms, int count)
+{
+    if (raw)
+    {
+        rawPixels((struct rawPixel *)pixels, iterations, norms, count);
+    }
+
+    else
+    {
+        colorPixels((pixel_t *)pixels, iterations, norms, count);
+    }
+}
+
+// Initializes the pixels array to avoid possible problems with left over values
+void fillPixels(unsigned char *pixels)
 {
-    fputc((char)red, stdout);
-    fputc((char)green, stdout);
-    fputc((char)blue, stdout);
+    // every byte of a black pixel (or of a raw pixel) is 0
+    memset(pixels, 0, pixelSize * imageSize);
+}
+
+// First row of a band when the image is cut into bands, the remainder rows are spread over the bands
+int bandRow(int band, int bands)
+{
+    // bands differ by at most one row and the last one ends at h
+    return (int)((long long)band * h / bands);
+}
+
+// Writes the calculated pixels, after the header, to the output image or the raw file
+void printPixels(unsigned char *pixels)
+{
+    // PPM (or raw) header of the output image
+    char header[256];
+
+    imageHeader(header, sizeof(header));
+
+    // the pixels already are R, G, B bytes (or raw records) in image order, they are written as they are
+    outputImage(header, pixels, pixelSize * imageSize);
+}
+
+// Formats the PPM (or raw) header of the output image
+void imageHeader(char *header, size_t size)
+{
+    if (raw)
+    {
+        rawHeader(header, size, w, h, maxIterations);
+    }
+
+    else
+    {
+        snprintf(header, size, "P6\n# Original Code CREATOR: Eric R. Weeks / mandel program - Changes by: Daniel V. Cordeiro & Rafael C. Pereira\n%d %d\n255\n", w, h);
+    }
 }
 
 // Calculates and prints execution time results and parameters
@@ -399,7 +574,73 @@ void getResults(double begin, double end, double end2, int size)
     // prints Execution Details
     fprintf(stderr, "W: %d, H: %d, Iterations: %d Processes:%i Threads: %i\n", w, h, maxIterations, size, numThreads);
 
+    // prints the kernel used by the master node and how busy the vector lanes of all processes were
+    fprintf(stderr, "Kernel: %s (%s), lane utilisation: %.2lf%%\n", escapeIsa, escapeMode, escapeUtilisation(&escapeTotals));
+
+    // prints the precision the pixels were iterated in, chosen from the pixel spacing and, for float, a sample of the view
+    if (!subdivideSelected() && !perturbSelected() && !progressiveSelected())
+        fprintf(stderr, "Precision: %s (pixel spacing %.3g).\n", precisionName, precisionSpacing);
+
+    if (!subdivideSelected() && !perturbSelected() && !progressiveSelected() && precisionMismatches >= 0)
+        fprintf(stderr, "Float sample: %d of %d pixels off the double reference, %d across maxIterations.\n", precisionMismatches, precisionSamples, precisionCrossed);
+
+    // prints how many pixels the interior pre-check painted without iterating
+    fprintf(stderr, "Interior pre-check: %lld pixels skipped.\n", escapeTotals.interior);
+
+    // prints how many orbits the periodicity check stopped before maxIterations
+    fprintf(stderr, "Periodicity check: %lld orbits converged.\n", escapeTotals.cycles);
+
+    // prints how many pixels the subdivision engine filled without iterating
+    if (subdivideSelected())
+        fprintf(stderr, "Subdivision: %lld pixels filled.\n", subdivideFilled);
+
+    // prints how many pixels the progressive engine interpolated without iterating, in all processes
+    if (progressiveSelected())
+        fprintf(stderr, "Progressive: %lld pixels interpolated (%s).\n", progressiveFilled, progressiveExact() ? "exact" : "interpolate");
+
+    // prints how many edge pixels took more samples, in all processes, and how many samples that took
+    if (antialias)
+        fprintf(stderr, "Anti-aliasing: %lld edge pixels, %lld sub-samples (%.2lf per pixel of the image, budget %d).\n", antialiasPixels, antialiasSamples, (double)antialiasSamples / imageSize, antialiasBudget());
+
+    // prints the reference orbits of all processes, glitches and iterations skipped by the perturbation engine
+    if (perturbSelected())
+        fprintf(stderr, "Perturbation: %lld reference orbits (%.4lf seconds for the first), %lld pixels glitched, %lld iterations skipped.\n", perturbReferences, perturbSeconds, perturbGlitched, perturbSkipped);
+
     // prints Elapsed times
     fprintf(stderr, "\nElapsed time: %.4lf seconds.\n", time_spent);
     fprintf(stderr, "\nElapsed time with printing: %.4lf seconds.\n", time_spent2);
+
+    // prints how fast the image was written
+    fprintf(stderr, "\nOutput: %.1lf MB in %.4lf seconds (%s, %.1lf MB/s).\n", outputBytes / 1e6, outputSeconds, outputMethod, outputThroughput());
+}
+
+// Prints the rows of every band, the share of the work the cost model predicted for it and the time it took
+// The predicted time is the predicted share of the time all the bands took together
+void printBands(const int *bandFirst, const double *bandCost, const double *bandTimes, int size, double previewTime)
+{
+    // total predicted cost and time spent by all the bands
+    double totalCost = 0, totalTime = 0;
+
+    // variable used to iterate over the bands
+    int aux;
+
+    for (aux = 0; aux < size; aux++)
+    {
+        totalCost += bandCost[aux];
+        totalTime += bandTimes[aux];
+    }
+
+    if (balanceSelected())
+        fprintf(stderr, "\nBands: cost model from a %dx%d preview (%d iterations) in %.4lf seconds.\n", (w < BALANCE_PREVIEW) ? w : BALANCE_PREVIEW, balancePreviewRows(h), (maxIterations < BALANCE_ITERATIONS) ? maxIterations : BALANCE_ITERATIONS, previewTime);
+    else
+        fprintf(stderr, "\nBands: equal rows.\n");
+
+    for (aux = 0; aux < size; aux++)
+    {
+        // with bands of equal rows there is no prediction
+        if (totalCost > 0)
+            fprintf(stderr, "Rank %d: rows %d-%d, predicted %.1lf%% of the work (%.4lf seconds), actual %.4lf seconds.\n", aux, bandFirst[aux], bandFirst[aux + 1] - 1, 100 * bandCost[aux] / totalCost, totalTime * bandCost[aux] / totalCost, bandTimes[aux]);
+        else
+            fprintf(stderr, "Rank %d: rows %d-%d, actual %.4lf seconds.\n", aux, bandFirst[aux], bandFirst[aux + 1] - 1, bandTimes[aux]);
+    }
 }
@@ -1,11 +1,7 @@
 #!/bin/bash
 
-old=1-1
-oldFile=mandelbrot-OMP-${old}.c
-
-cat c_names.txt | while read line 
+# every job gets its own copy of the program in the folder above, which includes ../Common
+cat names.txt | while read line 
 do
-   cp ${oldFile} mandelbrot-OMP-${line}.c
-   old=${line}
-   oldFile=mandelbrot-OMP-${line}.c
+   cp ../mandelbrot-OMP.c mandelbrot-OMP-${line}.c
 done
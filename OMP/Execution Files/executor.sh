@@ -1,7 +1,8 @@
 #!/bin/bash
 
+# the copies include ../Common, which -I.. finds next to the OMP folder
 cat names.txt | while read line 
 do
-   gcc -lm -o mandelbrot-OMP-${line} -fopenmp mandelbrot-OMP-${line}.c
+   gcc -O2 -I.. -fopenmp -o mandelbrot-OMP-${line} mandelbrot-OMP-${line}.c -lm
    qsub ${line}.sh
 done
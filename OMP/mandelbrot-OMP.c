@@ -20,13 +20,63 @@
 #include <stdio.h>
 #include <omp.h>
 
+#include "../Common/mandelbrot-kernel.h"
+#include "../Common/mandelbrot-subdivide.h"
+#include "../Common/mandelbrot-progressive.h"
+#include "../Common/mandelbrot-antialias.h"
+#include "../Common/mandelbrot-perturbation.h"
+#include "../Common/mandelbrot-precision.h"
+#include "../Common/mandelbrot-output.h"
+#include "../Common/mandelbrot-raw.h"
+#include "../Common/mandelbrot-animation.h"
+#include "../Common/mandelbrot-expmap.h"
+#include "../Common/mandelbrot-tiles.h"
+
+// Number of rows rendered at once by the subdivision engine
+#define SUBDIVIDE_BAND 512
+
+// colors [R, G ,B]
+typedef unsigned char pixel_t[3]; 
+
 /*---- Generating Image Output ---------------------------------------------------------------*/
 
-void color(int red, int green, int blue)
+// Converts the escape iteration and final |z|^2 of count pixels into their colors
+void colorPixels(pixel_t *pixels, const int *iterations, const double *norms, int count, int maxIterations)
+{
+    int p;
+
+    for (p = 0; p < count; p++)
+    {
+        // "i" will represent the number of iterations
+        int i = iterations[p];
+
+        // color(i % 256, 255, 255 * (i < maxIterations));
+        if (i == maxIterations)
+        {
+            //color(0, 0, 0); // black
+            pixels[p][0] = 0;
+            pixels[p][1] = 0;
+            pixels[p][2] = 0;
+        }
+
+        else
+        {
+            int brightness = escapeBrightness(i, norms[p], maxIterations);
+            //color(brightness, brightness, 255);
+            pixels[p][0] = brightness;
+            pixels[p][1] = brightness;
+            pixels[p][2] = 255;
+        }
+    }
+}
+
+// Stores count pixels of the image, from pixel p on, as colors or, in raw mode, as the kernel left them
+void storePixels(unsigned char *image, size_t p, const int *iterations, const double *norms, int count, int maxIterations, int raw)
 {
-    fputc((char)red, stdout);
-    fputc((char)green, stdout);
-    fputc((char)blue, stdout);
+    if (raw)
+        rawPixels((struct rawPixel *)image + p, iterations, norms, count);
+    else
+        colorPixels((pixel_t *)image + p, iterations, norms, count, maxIterations);
 }
 
 int main(int argc, char *argv[])
@@ -52,94 +102,258 @@ int main(int argc, char *argv[])
     *------------------------------------------------------------------------------------------*/
 
     // Height x Width of the generated Image
-    int w = 600, h = 400, x, y;
+    int w = 600, h = 400, y;
 
     // after how many iterations the function should stop
     int maxIterations = 10000;                
 
-    // real and imaginary part of the pixel p
-    double pr, pi;    
-
-    // real and imaginary parts of new and old z
-    double newRe, newIm, oldRe, oldIm;        
-    
     // zoom and position
     double zoom = 1, moveX = -0.5, moveY = 0; 
-    
-    // colors [R, G ,B]
-    typedef unsigned char pixel_t[3]; 
 
-    // Allocating space for all the pixels
-    pixel_t *pixels = malloc(sizeof(pixel_t)*h*w);
+    // image size, zoom and position used by the kernel
+    struct view view = {w, h, zoom, moveX, moveY};
+
+    // MANDELBROT_ZOOM, MANDELBROT_CENTER_RE and MANDELBROT_CENTER_IM move the view
+    viewInit(&view);
+
+    // whether the escape iterations and final |z|^2 are written instead of the colors
+    int raw = rawSelected();
+
+    // whether the edges of the image take more samples, MANDELBROT_AA; the sub-samples are colored and iterated
+    // in double precision, which the raw output and deep zooms cannot use
+    int antialias = antialiasSelected() && !raw && !perturbSelected();
+
+    // Allocating space for all the pixels, colors [R, G, B] or struct rawPixel
+    size_t pixelSize = raw ? sizeof(struct rawPixel) : sizeof(pixel_t);
+    // allocated once the output is known: with MANDELBROT_WRITER=mmap, the output file mapped into memory
+    unsigned char *pixels = NULL;
+
+    // whether the pixels are calculated straight into the output file
+    int mapped = 0;
+
+    // PPM (or raw) header of the output image
+    char header[128];
 
     // variables used to calculate execution time
     double time_spent, begin, end;
-    
+
+    // seconds spent calculating the exponential map and resampling its frames, in an animation
+    double stripTime = 0, frameTime = 0;
+
 
     /*---- Printing Execution Details --------------------------------------------------------*/
 
-    printf("P6\n# CREATOR: Eric R. Weeks / mandel program\n");
-    printf("%d %d\n255\n", w, h);
+    if (raw)
+        rawHeader(header, sizeof(header), w, h, maxIterations);
+    else
+        snprintf(header, sizeof(header), "P6\n# CREATOR: Eric R. Weeks / mandel program\n%d %d\n255\n", w, h);
 
 
     /*---- Data ------------------------------------------------------------------------------*/
+
+    // selects the widest SIMD kernel supported by this node
+    escapeInit();
+
+    // MANDELBROT_ANIMATION renders the frames of a keyframe file, resampled from an exponential map
+    if (animationInit() != 0)
+    {
+        fprintf(stderr, "Error reading the keyframes of %s\n", getenv("MANDELBROT_ANIMATION"));
+        return 1;
+    }
+
+    if (animationFrames > 0 && perturbSelected())
+    {
+        fprintf(stderr, "The perturbation engine renders single images, not animations\n");
+        return 1;
+    }
+
+    // the frames of an animation in raw mode are raw files one after the other
+    animationY4m = animationY4m && !raw;
+
+    // double, double-double or quad, from the pixel spacing of the view
+    precisionInit(&view, maxIterations);
+
+    // MANDELBROT_WRITER=mmap: the output is created at its full size and the threads write the pixels into it,
+    // the page cache writes them back while the image is calculated and there is no copy of the image to write
+    if (animationFrames == 0 && getenv("MANDELBROT_WRITER") != NULL && strcmp(getenv("MANDELBROT_WRITER"), "mmap") == 0)
+    {
+        pixels = outputMapStart(header, pixelSize * h * w);
+        mapped = pixels != NULL;
+
+        if (!mapped)
+            fprintf(stderr, "MANDELBROT_WRITER=mmap needs MANDELBROT_FILE or stdout to be a regular file, the image is written at the end\n");
+    }
+
+    if (!mapped)
+        pixels = malloc(pixelSize * h * w);
+
+    // MANDELBROT_TILES: the per-pixel loop takes 2D tiles along a Hilbert or Morton curve instead of rows
+    tileInit(w, h);
     
     // start counting execution time
     begin = omp_get_wtime();
 
-    // Beginning of the OMP parallel section
-    #pragma omp parallel shared(zoom, moveX, moveY, pixels) private(y, x, pr, pi, newRe, newIm, oldRe, oldIm)
+    // perturbation engine: computes the reference orbit of the center of the view
+    perturbInit(&view, maxIterations);
+
+    // Animation: the exponential map is calculated once, then every frame is resampled from it and written
+    if (animationFrames > 0)
     {
-        // determining the scheduling type of the loop - dynamic
-        // OpenMP divides the iterations into chunks of default size
-        #pragma omp for schedule(dynamic)
+        double zoomMin = INFINITY, zoomMax = 0;
+        int frame, j;
 
-        //loop through every pixel
-        for (y = 0; y < h; y++)
-            for (x = 0; x < w; x++)
+        // the zoom range of the frames, the map zooms into the center of the last keyframe
+        for (frame = 0; frame < animationFrames; frame++)
+        {
+            animationView(frame, &view);
+            zoomMin = fmin(zoomMin, view.zoom);
+            zoomMax = fmax(zoomMax, view.zoom);
+        }
+
+        expmapInit(w, h, zoomMin, zoomMax, animationKeys[animationKeyCount - 1].re, animationKeys[animationKeyCount - 1].im);
+
+        // colors [R, G, B] or struct rawPixel of every sample of the map
+        unsigned char *strip = malloc(pixelSize * expmapColumns * expmapRows);
+
+        #pragma omp parallel shared(strip) private(j)
+        {
+            struct escapeWork work;
+            escapeWorkInit(&work, expmapColumns);
+
+            // the rows near the center of the zoom take longer, they are handed out as threads finish
+            #pragma omp for schedule(dynamic)
+            for (j = 0; j < expmapRows; j++)
             {
-                // calculate the initial real and imaginary part of z, based on the pixel location and zoom and position values
-                pr = 1.5 * (x - w / 2) / (0.5 * zoom * w) + moveX;
-                pi = (y - h / 2) / (0.5 * zoom * h) + moveY;
-                newRe = newIm = oldRe = oldIm = 0; //these should start at 0,0
-
-                // "i" will represent the number of iterations
-                int i;
-                // start the iteration process
-                for (i = 0; i < maxIterations; i++)
-                {
-                    // remember value of previous iteration
-                    oldRe = newRe;
-                    oldIm = newIm;
-                    //the actual iteration, the real and imaginary part are calculated
-                    newRe = oldRe * oldRe - oldIm * oldIm + pr;
-                    newIm = 2 * oldRe * oldIm + pi;
-                    //if the point is outside the circle with radius 2: stop
-                    if ((newRe * newRe + newIm * newIm) > 4)
-                        break;
-                }
+                expmapRow(j, maxIterations, &work);
+
+                storePixels(strip, (size_t)j * expmapColumns, work.iterations, work.norms, expmapColumns, maxIterations, raw);
+            }
+
+            escapeWorkFree(&work);
+        }
+
+        stripTime = omp_get_wtime() - begin;
+
+        animationStart(w, h);
 
-                // color(i % 256, 255, 255 * (i < maxIterations));
-                if (i == maxIterations)
+        // each frame is resampled in parallel and written before the next one reuses the buffer
+        for (frame = 0; frame < animationFrames; frame++)
+        {
+            double resample = omp_get_wtime();
+
+            animationView(frame, &view);
+            expmapFrame(strip, pixelSize, raw, w, h, view.zoom, pixels);
+
+            frameTime += omp_get_wtime() - resample;
+
+            animationWrite(header, pixels, pixelSize * h * w, w, h);
+        }
+
+        free(strip);
+        expmapFree();
+    }
+
+    // Mariani-Silver, progressive or perturbation engine: the image is rendered in bands of rows, each one in parallel by the engine
+    else if (subdivideSelected() || perturbSelected() || progressiveSelected())
+    {
+        // escape iteration and final |z|^2 of each pixel of the current band
+        int *iterations = malloc(sizeof(int) * SUBDIVIDE_BAND * w);
+        double *norms = malloc(sizeof(double) * SUBDIVIDE_BAND * w);
+
+        // progressive engine: the coarse grid of the whole image comes first, it is the first pass of every band
+        // and, with MANDELBROT_PREVIEW, a low resolution image written before the rest is calculated
+        if (progressiveSelected())
+        {
+            progressiveCoarseInit(&view, maxIterations);
+
+            if (getenv("MANDELBROT_PREVIEW") != NULL)
+            {
+                int columns = progressiveCoarseCount(w), rows = progressiveCoarseCount(h);
+                pixel_t *preview = malloc(sizeof(pixel_t) * columns * rows);
+
+                colorPixels(preview, progressiveCoarseIterations, progressiveCoarseNorms, columns * rows, maxIterations);
+                progressivePreview(getenv("MANDELBROT_PREVIEW"), (unsigned char *)preview, columns, rows);
+
+                free(preview);
+            }
+        }
+
+        for (y = 0; y < h; y += SUBDIVIDE_BAND)
+        {
+            int last = (y + SUBDIVIDE_BAND < h) ? y + SUBDIVIDE_BAND : h;
+            int row;
+
+            if (perturbSelected())
+                perturbRender(&view, y, last, maxIterations, iterations, norms);
+            else if (progressiveSelected())
+                progressiveRender(&view, y, last, maxIterations, iterations, norms);
+            else
+                subdivideRender(&view, y, last, maxIterations, iterations, norms);
+
+            #pragma omp parallel for schedule(static)
+            for (row = y; row < last; row++)
+            {
+                storePixels(pixels, (size_t)row * w, iterations + (row - y) * w, norms + (row - y) * w, w, maxIterations, raw);
+            }
+        }
+
+        free(iterations);
+        free(norms);
+    }
+
+    else
+    {
+        // Beginning of the OMP parallel section
+        #pragma omp parallel shared(view, pixels, raw) private(y)
+        {
+            // coordinates, escape iteration and final |z|^2 of each pixel of the current row
+            struct escapeWork work;
+            escapeWorkInit(&work, w);
+
+            if (tilesSelected())
+            {
+                int t;
+
+                // the tiles are handed out along the curve, so the threads work on neighbouring tiles
+                #pragma omp for schedule(dynamic)
+                for (t = 0; t < tileCount; t++)
                 {
-                    //color(0, 0, 0); // black
-                    pixels[y * w + x][0] = 0;
-                    pixels[y * w + x][1] = 0;
-                    pixels[y * w + x][2] = 0;
+                    int x0, y0, tw, th, row;
+
+                    tileRect(t, w, h, &x0, &y0, &tw, &th);
+
+                    for (row = y0; row < y0 + th; row++)
+                    {
+                        precisionRow(&view, row, x0, tw, maxIterations, &work);
+
+                        storePixels(pixels, (size_t)row * w + x0, work.iterations, work.norms, tw, maxIterations, raw);
+                    }
                 }
+            }
 
-                else
+            else
+            {
+                // determining the scheduling type of the loop - dynamic
+                // OpenMP divides the iterations into chunks of default size
+                #pragma omp for schedule(dynamic)
+
+                //loop through every row, the kernel iterates several pixels of the row at once
+                for (y = 0; y < h; y++)
                 {
-                    double z = sqrt(newRe * newRe + newIm * newIm);
-                    int brightness = 256 * log2(1.75 + i - log2(log2(z))) / log2((double)maxIterations);
-                    //color(brightness, brightness, 255);
-                    pixels[y * w + x][0] = brightness;
-                    pixels[y * w + x][1] = brightness;
-                    pixels[y * w + x][2] = 255;
+                    precisionRow(&view, y, 0, w, maxIterations, &work);
+
+                    storePixels(pixels, (size_t)y * w, work.iterations, work.norms, w, maxIterations, raw);
                 }
             }
+
+            escapeWorkFree(&work);
+        }
+        // End of the OMP parallel section
     }
-    // End of the OMP parallel section
+
+    // MANDELBROT_AA: the edges of the image take more samples
+    if (antialias && animationFrames == 0)
+        antialiasRect(&view, 0, 0, w, h, maxIterations, pixels, w);
 
     // stop counting execution time 
     end = omp_get_wtime();
@@ -147,13 +361,12 @@ int main(int argc, char *argv[])
 
     /*---- Results ------------------------------------------------------------------------------*/
 
-    // sends colors of each pixel to be printed in the output image
-    for (y = 0; y < h; y++){
-        for (x = 0; x < w; x++)
-        {
-            color(pixels[y * w + x][0], pixels[y * w + x][1], pixels[y * w + x][2]);
-        }
-    }
+    // the pixels already are R, G, B bytes (or raw records) in image order, they are written as they are
+    // the frames of an animation were written as they were resampled
+    if (mapped)
+        outputMapEnd();
+    else if (animationFrames == 0)
+        outputImage(header, pixels, pixelSize * h * w);
 
     // calculates time spent
     time_spent = (end - begin);
@@ -161,8 +374,55 @@ int main(int argc, char *argv[])
     // prints Elapsed time
     fprintf(stderr, "Elapsed time: %.4lf seconds.\n", time_spent);
 
+    // prints the kernel used by this node and how busy its vector lanes were
+    fprintf(stderr, "Kernel: %s (%s), lane utilisation: %.2lf%%\n", escapeIsa, escapeMode, escapeUtilisation(&escapeTotals));
+
+    // prints the size of the exponential map against the pixels of the frames resampled from it
+    if (animationFrames > 0)
+        fprintf(stderr, "Exponential map: %d x %d samples in %.4lf seconds, %d frames (%.1lfx the samples) resampled in %.4lf seconds.\n", expmapColumns, expmapRows, stripTime, animationFrames, (double)animationFrames * w * h / ((double)expmapColumns * expmapRows), frameTime);
+
+    // prints the precision the pixels were iterated in, chosen from the pixel spacing and, for float, a sample of the view
+    else if (!subdivideSelected() && !perturbSelected() && !progressiveSelected())
+        fprintf(stderr, "Precision: %s (pixel spacing %.3g).\n", precisionName, precisionSpacing);
+
+    if (animationFrames == 0 && !subdivideSelected() && !perturbSelected() && !progressiveSelected() && precisionMismatches >= 0)
+        fprintf(stderr, "Float sample: %d of %d pixels off the double reference, %d across maxIterations.\n", precisionMismatches, precisionSamples, precisionCrossed);
+
+    // prints the tiles the per-pixel loop was cut into
+    if (tilesSelected() && animationFrames == 0 && !subdivideSelected() && !perturbSelected() && !progressiveSelected())
+        fprintf(stderr, "Tiles: %d of %dx%d pixels, %s order.\n", tileCount, tileSide, tileSide, tileOrderName);
+
+    // prints how many pixels the interior pre-check painted without iterating
+    fprintf(stderr, "Interior pre-check: %lld pixels skipped.\n", escapeTotals.interior);
+
+    // prints how many orbits the periodicity check stopped before maxIterations
+    fprintf(stderr, "Periodicity check: %lld orbits converged.\n", escapeTotals.cycles);
+
+    // prints how many pixels the subdivision engine filled without iterating
+    if (subdivideSelected())
+        fprintf(stderr, "Subdivision: %lld pixels filled.\n", subdivideFilled);
+
+    // prints how many pixels the progressive engine interpolated without iterating
+    if (progressiveSelected() && animationFrames == 0)
+        fprintf(stderr, "Progressive: %lld pixels interpolated (%s).\n", progressiveFilled, progressiveExact() ? "exact" : "interpolate");
+
+    // prints how many edge pixels took more samples and how many samples that took
+    if (antialias && animationFrames == 0)
+        fprintf(stderr, "Anti-aliasing: %lld edge pixels, %lld sub-samples (%.2lf per pixel of the image, budget %d).\n", antialiasPixels, antialiasSamples, (double)antialiasSamples / ((double)w * h), antialiasBudget());
+
+    // prints the reference orbits, glitches and iterations skipped by the perturbation engine
+    if (perturbSelected())
+        fprintf(stderr, "Perturbation: %lld reference orbits (%.4lf seconds for the first), %lld pixels glitched, %lld iterations skipped.\n", perturbReferences, perturbSeconds, perturbGlitched, perturbSkipped);
+
+    // prints how fast the image was written
+    fprintf(stderr, "Output: %.1lf MB in %.4lf seconds (%s, %.1lf MB/s).\n", outputBytes / 1e6, outputSeconds, outputMethod, outputThroughput());
+
     // deallocates the memory previously allocated
-    free(pixels);
+    if (!mapped)
+        free(pixels);
+    free(tileOrder);
+    free(progressiveCoarseIterations);
+    free(progressiveCoarseNorms);
 
     // ends the program
     return 0;
@@ -19,11 +19,15 @@
 #include <time.h>
 #include <stdio.h>
 
-void color(int red, int green, int blue)
+#include "../Common/mandelbrot-kernel.h"
+#include "../Common/mandelbrot-output.h"
+#include "../Common/mandelbrot-raw.h"
+
+void color(unsigned char *pixel, int red, int green, int blue)
 {
-    fputc((char)red, stdout);
-    fputc((char)green, stdout);
-    fputc((char)blue, stdout);
+    pixel[0] = red;
+    pixel[1] = green;
+    pixel[2] = blue;
 }
 
 int main(int argc, char *argv[])
@@ -31,58 +35,66 @@ int main(int argc, char *argv[])
 //    int w = 600, h = 400, x, y;
     int w = 600, h = 400, x, y;
     //each iteration, it calculates: newz = oldz*oldz + p, where p is the current pixel, and oldz stars at the origin
-    double pr, pi;                   //real and imaginary part of the pixel p
-    double newRe, newIm, oldRe, oldIm;   //real and imaginary parts of new and old z
     double zoom = 1, moveX = -0.5, moveY = 0; //you can change these to zoom and change position
     int maxIterations = 100000;//after how much iterations the function should stop
+    struct view view = {w, h, zoom, moveX, moveY}; //image size, zoom and position used by the kernel
+    struct escapeWork work; //coordinates, escape iteration and final |z|^2 of each pixel of the current row
+    int raw = rawSelected(); //whether the escape iterations and final |z|^2 are written instead of the colors
+    size_t pixelSize = raw ? sizeof(struct rawPixel) : 3;
+    unsigned char *image = malloc(pixelSize * w * h); //R, G, B bytes (or raw records) of every pixel, written at the end
+    char header[128];
     
     clock_t begin, end;
     double time_spent;
     
-    printf("P6\n# CREATOR: Eric R. Weeks / mandel program\n");
-    printf("%d %d\n255\n",w,h);
+    if(raw)
+        rawHeader(header, sizeof(header), w, h, maxIterations);
+    else
+        snprintf(header, sizeof(header), "P6\n# CREATOR: Eric R. Weeks / mandel program\n%d %d\n255\n",w,h);
+    
+    escapeInit(); //selects the widest SIMD kernel supported by this node
+    escapeWorkInit(&work, w);
     
     begin = clock();
     
-    //loop through every pixel
+    //loop through every row, the kernel iterates several pixels of the row at once
     for(y = 0; y < h; y++)
+    {
+        escapeRow(&view, y, 0, w, maxIterations, &work);
+        if(raw)
+        {
+            rawPixels((struct rawPixel *)image + (size_t)y * w, work.iterations, work.norms, w);
+            continue;
+        }
         for(x = 0; x < w; x++)
         {
-            //calculate the initial real and imaginary part of z, based on the pixel location and zoom and position values
-            pr = 1.5 * (x - w / 2) / (0.5 * zoom * w) + moveX;
-            pi = (y - h / 2) / (0.5 * zoom * h) + moveY;
-            newRe = newIm = oldRe = oldIm = 0; //these should start at 0,0
             //"i" will represent the number of iterations
-            int i;
-            //start the iteration process
-            for(i = 0; i < maxIterations; i++)
-            {
-                //remember value of previous iteration
-                oldRe = newRe;
-                oldIm = newIm;
-                //the actual iteration, the real and imaginary part are calculated
-                newRe = oldRe * oldRe - oldIm * oldIm + pr;
-                newIm = 2 * oldRe * oldIm + pi;
-                //if the point is outside the circle with radius 2: stop
-                if((newRe * newRe + newIm * newIm) > 4) break;
-            }
+            int i = work.iterations[x];
             
 //            color(i % 256, 255, 255 * (i < maxIterations));
             if(i == maxIterations)
-                color(0, 0, 0); // black
+                color(image + 3 * ((size_t)y * w + x), 0, 0, 0); // black
             else
             {
-                double z = sqrt(newRe * newRe + newIm * newIm);
-                int brightness = 256 * log2(1.75 + i - log2(log2(z))) / log2((double)maxIterations);
-                color(brightness, brightness, 255);
+                int brightness = escapeBrightness(i, work.norms[x], maxIterations);
+                color(image + 3 * ((size_t)y * w + x), brightness, brightness, 255);
             }
             
         }
+    }
     
     end = clock();
     
+    outputImage(header, image, pixelSize * w * h);
+    
     time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
     fprintf(stderr, "Elapsed time: %.2lf seconds.\n", time_spent);
+    fprintf(stderr, "Kernel: %s\n", escapeIsa);
+    fprintf(stderr, "Interior pre-check: %lld pixels skipped.\n", work.stats.interior);
+    fprintf(stderr, "Periodicity check: %lld orbits converged.\n", work.stats.cycles);
+    fprintf(stderr, "Output: %.1lf MB in %.4lf seconds (%s, %.1lf MB/s).\n", outputBytes / 1e6, outputSeconds, outputMethod, outputThroughput());
     
+    escapeWorkFree(&work);
+    free(image);
     return 0;
 }
@@ -0,0 +1,178 @@
+//
+//  mandelbrot-recolor.c
+//
+//
+//  Produces the PPM image of a raw file written by the OMP, Hybrid or
+//  sequential programs with MANDELBROT_OUTPUT=raw.
+//
+//  The raw file holds the escape iteration and the final |z|^2 of every
+//  pixel, so the smooth coloring can be applied here with any palette,
+//  without iterating the pixels again. The rows are colored in parallel
+//  with OpenMP.
+//
+//  Usage:
+//      mandelbrot-recolor [input.raw|-] [palette] > output.ppm
+//
+//  Palettes:
+//      blue  (default) the colors of the programs themselves
+//      gray  shades of gray
+//      fire  black through red and yellow to white
+//
+
+#include <stdio.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "../Common/mandelbrot-color.h"
+#include "../Common/mandelbrot-output.h"
+#include "../Common/mandelbrot-raw.h"
+
+// colors [R, G ,B]
+typedef unsigned char pixel_t[3];
+
+/*---- Palettes ---------------------------------------------------------------*/
+
+// Colors a pixel outside the set from its smooth brightness
+typedef void (*palette)(pixel_t pixel, int brightness);
+
+void paletteBlue(pixel_t pixel, int brightness)
+{
+    pixel[0] = brightness;
+    pixel[1] = brightness;
+    pixel[2] = 255;
+}
+
+void paletteGray(pixel_t pixel, int brightness)
+{
+    pixel[0] = brightness;
+    pixel[1] = brightness;
+    pixel[2] = brightness;
+}
+
+void paletteFire(pixel_t pixel, int brightness)
+{
+    // the brightness wraps at 256 like in the other palettes, the ramp goes through 3 channels
+    int level = 3 * (brightness & 255);
+
+    pixel[0] = level > 255 ? 255 : level;
+    pixel[1] = level > 510 ? 255 : (level > 255 ? level - 255 : 0);
+    pixel[2] = level > 510 ? level - 510 : 0;
+}
+
+// Palette called name, or NULL if there is none
+palette findPalette(const char *name)
+{
+    if (strcmp(name, "blue") == 0)
+        return paletteBlue;
+
+    if (strcmp(name, "gray") == 0)
+        return paletteGray;
+
+    if (strcmp(name, "fire") == 0)
+        return paletteFire;
+
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    /*---- Getting User Inputs -----------------------------------------------------------*/
+
+    // [1] = Raw file, "-" or nothing for the standard input
+    // [2] = Palette
+    const char *input = (argc >= 2) ? argv[1] : "-";
+    palette color = findPalette((argc >= 3) ? argv[2] : "blue");
+
+    if (color == NULL)
+    {
+        fprintf(stderr, "Unknown palette %s, use blue, gray or fire\n", argv[2]);
+        return 1;
+    }
+
+    /*---- Reading the Raw File -----------------------------------------------------------*/
+
+    FILE *stream = strcmp(input, "-") == 0 ? stdin : fopen(input, "rb");
+
+    // Height x Width of the image and the iterations it was rendered with
+    int w, h, maxIterations;
+
+    if (stream == NULL || rawReadHeader(stream, &w, &h, &maxIterations) != 0)
+    {
+        fprintf(stderr, "Error reading the raw file %s\n", input);
+        return 1;
+    }
+
+    size_t count = (size_t)w * h;
+    struct rawPixel *raw = malloc(sizeof(struct rawPixel) * count);
+    pixel_t *pixels = malloc(sizeof(pixel_t) * count);
+
+    if (fread(raw, sizeof(struct rawPixel), count, stream) != count)
+    {
+        fprintf(stderr, "Error reading the raw file %s: it is shorter than %dx%d pixels\n", input, w, h);
+
+        if (stream != stdin)
+            fclose(stream);
+
+        free(raw);
+        free(pixels);
+        return 1;
+    }
+
+    if (stream != stdin)
+        fclose(stream);
+
+    /*---- Coloring ------------------------------------------------------------------------------*/
+
+    // start counting execution time
+    double begin = omp_get_wtime();
+
+    int y;
+
+    #pragma omp parallel for schedule(static)
+    for (y = 0; y < h; y++)
+    {
+        size_t p;
+
+        for (p = (size_t)y * w; p < (size_t)(y + 1) * w; p++)
+        {
+            int i = raw[p].iteration;
+
+            if (i == maxIterations)
+            {
+                pixels[p][0] = 0;
+                pixels[p][1] = 0;
+                pixels[p][2] = 0;
+            }
+
+            else
+                color(pixels[p], escapeBrightness(i, raw[p].norm, maxIterations));
+        }
+    }
+
+    // stop counting execution time
+    double end = omp_get_wtime();
+
+    /*---- Results ------------------------------------------------------------------------------*/
+
+    char header[128];
+
+    snprintf(header, sizeof(header), "P6\n# CREATOR: Eric R. Weeks / mandel program\n%d %d\n255\n", w, h);
+
+    outputImage(header, (unsigned char *)pixels, sizeof(pixel_t) * count);
+
+    // prints Elapsed time
+    fprintf(stderr, "Elapsed time: %.4lf seconds.\n", end - begin);
+
+    // prints how fast the image was written
+    fprintf(stderr, "Output: %.1lf MB in %.4lf seconds (%s, %.1lf MB/s).\n", outputBytes / 1e6, outputSeconds, outputMethod, outputThroughput());
+
+    // deallocates the memory previously allocated
+    free(raw);
+    free(pixels);
+
+    // ends the program
+    return 0;
+}